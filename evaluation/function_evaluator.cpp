@@ -3,165 +3,648 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
-#include <iostream>
-#include <thread>
+#include <stdexcept>
 
 static constexpr unsigned BUFFER_SIZE_COEFFICIENT = 2;
 static constexpr double MIN_CACHE_REEVALUATION_MARGIN = 0.1;
+static constexpr unsigned CULLING_LEAF_SIZE = 32;
+static constexpr unsigned EVALUATION_BLOCK_SIZE = 256;
+static constexpr unsigned TILE_SIZE = TileCache::TILE_SIZE;
+/**
+ * Distance between the grid points adaptive sampling starts from, a power of 2
+ */
+static constexpr unsigned ADAPTIVE_INITIAL_STRIDE = 32;
+/**
+ * Part of the margins of a prefetched buffer placed ahead of the window in the direction of
+ * panning
+ */
+static constexpr double PAN_DIRECTION_SHARE = 0.75;
 
 FunctionEvaluator::FunctionEvaluator(const std::vector<const ParsedFunction*>& functions,
-                                     const bool cachingEnabled): functions(functions),
-                                                                 cachingEnabled(cachingEnabled) { }
+                                     const bool cachingEnabled,
+                                     const unsigned threadsCount,
+                                     const bool singlePrecision): functions(functions),
+                                                                  cachingEnabled(cachingEnabled),
+                                                                  singlePrecision(singlePrecision),
+                                                                  pool(threadsCount) { }
 
 const std::vector<const ParsedFunction*>& FunctionEvaluator::parsedFunctions() const {
     return functions;
 }
 
+/**
+ * Takes the lock only when the published buffer does not serve the window, to evaluate a new
+ * one. The returned PlotData views the samples of the buffer without copying them.
+ */
 PlotData* FunctionEvaluator::evaluate(const double xMin, const double xMax,
                                       const unsigned pointsCount) {
     if (xMin >= xMax) {
         return nullptr;
     }
-    semaphore.lock();
-    if (pointsCount != pointsPerFunction || outOfBounds(xMin, xMax) || rangeSmaller(xMin, xMax)) {
-        if (pointsCount != pointsPerFunction) {
-            delete buffer;
-            pointsPerFunction = pointsCount;
-            buffer = new Point[bufferSize()];
-        }
-        calculateFunctionPoints(xMin, xMax, pointsPerFunction);
-        std::cout << std::flush;
-    }
-    const Point* windowStart = std::lower_bound(buffer, buffer + bufferSize(), xMin,
-                                                [](const Point& p, const double x) {
-                                                    return p.x() < x;
-                                                });
-    const Point* windowEnd = std::upper_bound(buffer, buffer + bufferSize(), xMax,
-                                              [](const double x, const Point& p) {
-                                                  return x < p.x();
-                                              });
-    auto* plotData = new PlotData(calculateBounds(windowStart, windowEnd), windowStart,
-                                  windowEnd - windowStart);
-    semaphore.unlock();
-    if (cachingEnabled && (closeToBufferStart(windowStart) || closeToBufferEnd(windowEnd))) {
-        std::thread backgroundThread([this, xMin, xMax] {
-            std::lock_guard lock(semaphore);
-            std::cout << "background ";
-            calculateFunctionPoints(xMin, xMax, pointsPerFunction);
-            std::cout << "fin" << std::endl;
+    auto* plotData = new PlotData();
+    evaluate(xMin, xMax, pointsCount, *plotData);
+    return plotData;
+}
+
+bool FunctionEvaluator::evaluate(const double xMin, const double xMax, const unsigned pointsCount,
+                                 PlotData& plotData) {
+    if (xMin >= xMax) {
+        return false;
+    }
+    const int level = std::ilogb((xMax - xMin) / (std::max(pointsCount, 2u) - 1));
+    const double step = std::ldexp(1.0, level);
+    const auto windowLength = static_cast<unsigned>(std::ceil((xMax - xMin) / step)) + 1;
+    unsigned length = ((windowLength * bufferSizeCoefficient() + TILE_SIZE - 1) / TILE_SIZE + 2) *
+                      TILE_SIZE;
+    std::shared_ptr<const Buffer> current = std::atomic_load(&buffer);
+    if (!serves(current.get(), xMin, xMax, level, length, pointsCount)) {
+        std::lock_guard lock(semaphore);
+        current = std::atomic_load(&buffer);
+        if (!serves(current.get(), xMin, xMax, level, length, pointsCount)) {
+            if (current && current->level == level && current->pointsCount == pointsCount) {
+                length = std::max(length, current->length);
+            }
+            if (prefetchUnread) {
+                ++statistics.wasted;
+                prefetchUnread = false;
+            }
+            current = moveBuffer(xMin, xMax, level, length, pointsCount);
+        }
+    }
+    view(*current, xMin, xMax, plotData);
+    followWindow(*current, xMin, xMax);
+    return true;
+}
+
+PrefetchStatistics FunctionEvaluator::prefetchStatistics() {
+    std::lock_guard lock(semaphore);
+    return statistics;
+}
+
+TileCacheStatistics FunctionEvaluator::tileCacheStatistics() const {
+    return tiles.statistics();
+}
+
+void FunctionEvaluator::setTileCacheBudget(const size_t budget) {
+    tiles.setBudget(budget);
+}
+
+/**
+ * Checks whether the buffer covers the window on the grid chosen for it. A buffer longer than
+ * needed serves as well, so that zooming in within a level keeps it.
+ */
+bool FunctionEvaluator::serves(const Buffer* current, const double xMin, const double xMax,
+                               const int level, const unsigned length,
+                               const unsigned pointsCount) {
+    return current && current->level == level && current->pointsCount == pointsCount &&
+           length <= current->length && current->xMin <= xMin && xMax <= current->xMax;
+}
+
+void FunctionEvaluator::view(const Buffer& current, const double xMin, const double xMax,
+                             PlotData& plotData) {
+    plotData.clear();
+    for (const std::shared_ptr<const SampleSeries>& segment : current.segments) {
+        plotData.addSeries(segment, segment->lowerIndex(xMin), segment->upperIndex(xMax));
+    }
+}
+
+/**
+ * Tracks the direction of panning and requests a prefetch when the window comes close to the
+ * edge of the buffer. This is skipped if a writer holds the lock, so that the evaluation does
+ * not wait for it; the next evaluation catches up.
+ */
+void FunctionEvaluator::followWindow(const Buffer& current, const double xMin,
+                                     const double xMax) {
+    const std::unique_lock lock(semaphore, std::try_to_lock);
+    if (!lock) {
+        return;
+    }
+    const double xCenter = (xMin + xMax) / 2;
+    if (xCenter != lastXCenter && !std::isnan(lastXCenter)) {
+        panDirection = xCenter > lastXCenter ? 1 : -1;
+    }
+    lastXCenter = xCenter;
+    if (prefetchUnread) {
+        ++statistics.used;
+        prefetchUnread = false;
+    }
+    if (cachingEnabled && std::atomic_load(&buffer).get() == &current &&
+        closeToEdge(xMin, xMax, current.xMin, current.xMax)) {
+        requestPrefetch(current, xMin, xMax);
+    }
+}
+
+/**
+ * Requests moving the buffer around the window, with most of its margin ahead in the direction
+ * of panning. The request supersedes the pending or running one, unless the buffer that one
+ * produces would serve the window without another prefetch.
+ */
+void FunctionEvaluator::requestPrefetch(const Buffer& current, const double xMin,
+                                        const double xMax) {
+    if (prefetchXMin <= xMin && xMax <= prefetchXMax &&
+        !closeToEdge(xMin, xMax, prefetchXMin, prefetchXMax)) {
+        return;
+    }
+    const std::int64_t origin = alignedOrigin(xMin, xMax, panDirection, current.level,
+                                              current.length);
+    if (origin == current.origin) {
+        return;
+    }
+    const double step = std::ldexp(1.0, current.level);
+    prefetchXMin = static_cast<double>(origin) * step;
+    prefetchXMax = static_cast<double>(origin + current.length - 1) * step;
+    if (pendingPrefetch) {
+        ++statistics.superseded;
+    }
+    pendingPrefetch = PrefetchRequest{origin, ++generation};
+    ++statistics.requested;
+    if (!prefetchRunning) {
+        prefetchRunning = true;
+        pool.submit([this] {
+            prefetch();
         });
-        backgroundThread.detach();
     }
-    return plotData;
 }
 
+/**
+ * Drops the pending prefetch and makes the running one drop its result
+ */
+void FunctionEvaluator::invalidatePrefetch() {
+    ++generation;
+    if (pendingPrefetch) {
+        ++statistics.superseded;
+        pendingPrefetch.reset();
+    }
+    prefetchXMin = INFINITY;
+    prefetchXMax = -INFINITY;
+}
+
+/**
+ * Evaluates the samples the buffer newly covers after the requested move and assembles the
+ * moved buffer without holding the lock, so the foreground is not blocked, then publishes it
+ * unless the request was superseded meanwhile. Every change of the published buffer supersedes
+ * the requests, so the moved buffer is never based on an outdated one. Evaluation of
+ * a superseded request is abandoned early. At most one such task runs per evaluator, until no
+ * request is pending.
+ */
+void FunctionEvaluator::prefetch() {
+    std::unique_lock lock(semaphore);
+    while (pendingPrefetch) {
+        const PrefetchRequest request = *pendingPrefetch;
+        pendingPrefetch.reset();
+        const std::shared_ptr<const Buffer> base = std::atomic_load(&buffer);
+        if (!base) {
+            continue;
+        }
+        const auto [first, count] = exposedRange(base.get(), request.origin, base->length);
+        const Sampling sampling = currentSampling(request.generation);
+        lock.unlock();
+
+        std::vector<SampleSeries> prefetched = evaluatePoints(base->functions, base->level,
+                                                              first, count, sampling);
+        std::shared_ptr<const Buffer> moved;
+        if (!cancelled(sampling)) {
+            Buffer next = *base;
+            next.origin = request.origin;
+            moved = movedBuffer(std::move(next), base.get(), std::move(prefetched));
+        }
+
+        lock.lock();
+        if (request.generation != generation) {
+            ++statistics.superseded;
+            continue;
+        }
+        if (prefetchUnread) {
+            ++statistics.wasted;
+        }
+        std::atomic_store(&buffer, moved);
+        prefetchUnread = true;
+        ++statistics.completed;
+    }
+    prefetchRunning = false;
+}
+
+bool FunctionEvaluator::cancelled(const Sampling& sampling) const {
+    return sampling.generation != 0 && sampling.generation != generation;
+}
+
+FunctionEvaluator::Sampling FunctionEvaluator::currentSampling(
+    const std::uint64_t prefetchGeneration) const {
+    return {
+        visibleRange, tolerance, prefetchGeneration, tiles.version(), adaptiveTolerance,
+        adaptiveBudget
+    };
+}
+
+/**
+ * Evaluates only the segment of the new function, the others are shared with the previous
+ * buffer
+ */
 void FunctionEvaluator::pushFunction(const ParsedFunction* derivative) {
     std::lock_guard lock(semaphore);
-    const double xMin = buffer->x();
-    const double xMax = buffer[bufferSize() - 1].x();
-    auto* newBuffer = new Point[bufferSize() + bufferSizeCoefficient() * pointsPerFunction];
-    std::copy_n(buffer, bufferSize(), newBuffer);
-    delete buffer;
-    buffer = newBuffer;
-    auto bufferCursor = buffer + bufferSize();
     functions.push_back(derivative);
-    evaluateSingleFunctionPoints(bufferSizeCoefficient() * pointsPerFunction, xMin, xMax,
-                                 *derivative, bufferCursor);
-    std::sort(buffer, buffer + bufferSize(), [](const Point& a, const Point& b) {
-        return a.x() < b.x();
-    });
+    invalidatePrefetch();
+    const std::shared_ptr<const Buffer> current = std::atomic_load(&buffer);
+    if (!current) {
+        return;
+    }
+    auto next = std::make_shared<Buffer>(*current);
+    next->functions.push_back(derivative);
+    next->segments.push_back(std::make_shared<const SampleSeries>(
+        std::move(evaluatePoints({derivative}, current->level, current->origin,
+                                 current->length, currentSampling(0)).front())));
+    std::atomic_store(&buffer, std::shared_ptr<const Buffer>(std::move(next)));
+}
+
+void FunctionEvaluator::removeFunction(const ParsedFunction* functionPtr) {
+    std::lock_guard lock(semaphore);
+    const auto found = std::find(functions.begin(), functions.end(), functionPtr);
+    if (found == functions.end()) {
+        return;
+    }
+    invalidatePrefetch();
+    functions.erase(found);
+    tiles.erase(functionPtr);
+    const std::shared_ptr<const Buffer> current = std::atomic_load(&buffer);
+    if (!current) {
+        return;
+    }
+    auto next = std::make_shared<Buffer>(*current);
+    const auto index = std::find(next->functions.begin(), next->functions.end(), functionPtr) -
+                       next->functions.begin();
+    next->functions.erase(next->functions.begin() + index);
+    next->segments.erase(next->segments.begin() + index);
+    std::atomic_store(&buffer, std::shared_ptr<const Buffer>(std::move(next)));
 }
 
+void FunctionEvaluator::setVisibleRange(const double yMin, const double yMax,
+                                        const double tolerance) {
+    std::lock_guard lock(semaphore);
+    if (visibleRange && visibleRange->lower == yMin && visibleRange->upper == yMax &&
+        this->tolerance == tolerance) {
+        return;
+    }
+    if (!visibleRange || visibleRange->lower != yMin || visibleRange->upper != yMax) {
+        tiles.clear();
+    }
+    visibleRange = Interval{yMin, yMax, true};
+    this->tolerance = tolerance;
+    invalidatePrefetch();
+    std::atomic_store(&buffer, std::shared_ptr<const Buffer>());
+}
+
+/**
+ * Tiles sampled with a greater tolerance are not served from the cache, but the cache is
+ * cleared when the budget changes, as tiles that ran out of it do not meet their tolerance
+ */
+void FunctionEvaluator::setAdaptiveSampling(const double tolerance, const double budget) {
+    if (!(tolerance >= 0) || !(budget > 0 && budget <= 1)) {
+        throw std::invalid_argument("Invalid adaptive sampling parameters");
+    }
+    std::lock_guard lock(semaphore);
+    if (adaptiveTolerance == tolerance && adaptiveBudget == budget) {
+        return;
+    }
+    if (adaptiveBudget != budget) {
+        tiles.clear();
+    }
+    adaptiveTolerance = tolerance;
+    adaptiveBudget = budget;
+    invalidatePrefetch();
+    std::atomic_store(&buffer, std::shared_ptr<const Buffer>());
+}
 
 ParsedFunction* FunctionEvaluator::computeDerivative(const ParsedFunction* function,
                                                      const double dx) {
+    if (ParsedFunction* derivative = function->derivative()) {
+        return derivative;
+    }
     return new FunctionWrapper([function, dx](const double x) {
         return ((*function)(x + dx) - (*function)(x - dx)) / (2 * dx);
     });
 }
 
 FunctionEvaluator::~FunctionEvaluator() {
-    delete[] buffer;
-}
-
-void FunctionEvaluator::calculateFunctionPoints(const double xMin, const double xMax,
-                                                const unsigned resolution) const {
-    std::cout << "cache reevaluation\n";
-    const double width = xMax - xMin;
-    const double margin = width * (bufferSizeCoefficient() - 1) / 2;
-    Point* bufferCursor = buffer;
-    for (const auto functionPtr : functions) {
-        bufferCursor = evaluateSingleFunctionPoints(bufferSizeCoefficient() * resolution,
-                                                    xMin - margin, xMax + margin, *functionPtr,
-                                                    bufferCursor);
-    }
-    std::sort(buffer, buffer + bufferSize(), [](const Point& a, const Point& b) {
-        return a.x() < b.x();
-    });
+    {
+        std::lock_guard lock(semaphore);
+        invalidatePrefetch();
+    }
+    pool.wait();
 }
 
-Point* FunctionEvaluator::evaluateSingleFunctionPoints(const unsigned resolution, const double xMin,
-                                                       const double xMax,
-                                                       const ParsedFunction& function,
-                                                       Point* bufferCursor) {
-    unsigned tail = 0;
-    const double width = xMax - xMin;
-    const double step = width / (resolution - 1);
-    for (int i = 0; tail < resolution; ++i) {
-        const double x = xMin + i * step;
-        const double y = function(x);
-        if (std::isfinite(y)) {
-            bufferCursor[tail++] = Point(x, y);
-        }
+/**
+ * Publishes a buffer on the given grid centered on the window, evaluating only the samples the
+ * current buffer does not cover, if it is on the same grid
+ * @return the published buffer
+ */
+std::shared_ptr<const FunctionEvaluator::Buffer> FunctionEvaluator::moveBuffer(
+    const double xMin, const double xMax, const int level, const unsigned length,
+    const unsigned pointsCount) {
+    invalidatePrefetch();
+    std::shared_ptr<const Buffer> base = std::atomic_load(&buffer);
+    if (base && (base->level != level || base->length != length ||
+                 base->pointsCount != pointsCount)) {
+        base.reset();
     }
-    return bufferCursor + tail;
+    const std::int64_t origin = alignedOrigin(xMin, xMax, 0, level, length);
+    const auto [first, count] = exposedRange(base.get(), origin, length);
+    std::shared_ptr<const Buffer> moved = movedBuffer(
+        {functions, {}, level, origin, length, pointsCount, 0, 0}, base.get(),
+        evaluatePoints(functions, level, first, count, currentSampling(0)));
+    std::atomic_store(&buffer, moved);
+    return moved;
 }
 
-size_t FunctionEvaluator::bufferSize() const {
-    return bufferSizeCoefficient() * pointsPerFunction * functions.size();
+/**
+ * Chooses the origin of a buffer covering the window with a part of the remaining margin on
+ * either side, most of it ahead in the given direction. The origin is a multiple of the tile
+ * size, so the buffer moves by whole tiles of the cache.
+ */
+std::int64_t FunctionEvaluator::alignedOrigin(const double xMin, const double xMax,
+                                              const int direction, const int level,
+                                              const unsigned length) {
+    const double step = std::ldexp(1.0, level);
+    const auto first = static_cast<std::int64_t>(std::ceil(xMin / step));
+    const auto last = static_cast<std::int64_t>(std::floor(xMax / step));
+    const std::int64_t lowest = last + 2 - length;
+    const std::int64_t highest = first - 1;
+    const double ahead = direction == 0 ? 0.5 : PAN_DIRECTION_SHARE;
+    const double leftShare = direction < 0 ? ahead : 1 - ahead;
+    std::int64_t origin = highest - std::llround((highest - lowest) * leftShare);
+    origin -= (origin % TILE_SIZE + TILE_SIZE) % TILE_SIZE;
+    return origin < lowest ? origin + TILE_SIZE : origin;
 }
 
-unsigned FunctionEvaluator::bufferSizeCoefficient() const {
-    return cachingEnabled ? BUFFER_SIZE_COEFFICIENT : 1;
+/**
+ * @param base buffer on the same grid, or nullptr
+ * @return the first grid index and the number of the samples a buffer of the given length at
+ * the origin covers but the base does not
+ */
+std::pair<std::int64_t, unsigned> FunctionEvaluator::exposedRange(const Buffer* base,
+                                                                  const std::int64_t origin,
+                                                                  const unsigned length) {
+    if (!base || std::abs(origin - base->origin) >= length) {
+        return {origin, length};
+    }
+    const std::int64_t distance = origin - base->origin;
+    if (distance > 0) {
+        return {base->origin + length, static_cast<unsigned>(distance)};
+    }
+    return {origin, static_cast<unsigned>(-distance)};
 }
 
-bool FunctionEvaluator::outOfBounds(const double xMin, const double xMax) const {
-    return xMin < buffer->x() || buffer[bufferSize() - 1].x() < xMax;
+/**
+ * Completes the moved buffer with segments made of copies of the ones of the base, slid to its
+ * origin, and of the exposed samples, or of the exposed samples alone if it shares none with
+ * the base
+ * @param moved buffer to complete, its segments are replaced
+ * @param base buffer on the same grid, or nullptr
+ */
+std::shared_ptr<const FunctionEvaluator::Buffer> FunctionEvaluator::movedBuffer(
+    Buffer moved, const Buffer* base, std::vector<SampleSeries> exposed) {
+    moved.segments.clear();
+    const bool overlapping = base && std::abs(moved.origin - base->origin) < moved.length;
+    for (size_t i = 0; i < exposed.size(); ++i) {
+        if (!overlapping) {
+            moved.segments.push_back(std::make_shared<const SampleSeries>(std::move(exposed[i])));
+            continue;
+        }
+        auto segment = std::make_shared<SampleSeries>(*base->segments[i]);
+        segment->slide(moved.origin - base->origin);
+        segment->copy(exposed[i]);
+        moved.segments.push_back(std::move(segment));
+    }
+    const double step = std::ldexp(1.0, moved.level);
+    moved.xMin = static_cast<double>(moved.origin) * step;
+    moved.xMax = static_cast<double>(moved.origin + moved.length - 1) * step;
+    return std::make_shared<const Buffer>(std::move(moved));
 }
 
-bool FunctionEvaluator::rangeSmaller(const double xMin, const double xMax) const {
-    return (buffer[bufferSize() - 1].x() - buffer->x()) / bufferSizeCoefficient() - (xMax - xMin) >
-           1e-13;
+/**
+ * Assembles the samples of the functions from tiles of the cache, evaluating the missing tiles
+ * in parallel and caching them. Each tile is evaluated on its own, so the results do not depend
+ * on the number of threads, on the position of the buffer, nor on whether the tile was cached.
+ * @param level binary logarithm of the distance between the samples
+ * @param origin grid index of the first sample, a multiple of the tile size
+ * @param resolution number of the samples, a multiple of the tile size
+ * @return samples of the evaluated functions
+ */
+std::vector<SampleSeries> FunctionEvaluator::evaluatePoints(
+    const std::vector<const ParsedFunction*>& evaluated, const int level,
+    const std::int64_t origin, const unsigned resolution, const Sampling& sampling) {
+    const double step = std::ldexp(1.0, level);
+    const double tileTolerance = std::max(sampling.visibleRange ? sampling.tolerance : 0,
+                                          sampling.adaptiveTolerance);
+    const unsigned tilesPerFunction = resolution / TILE_SIZE;
+    const std::int64_t firstTile = origin / static_cast<std::int64_t>(TILE_SIZE);
+    std::vector<TileCache::TilePtr> functionTiles(evaluated.size() * tilesPerFunction);
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < functionTiles.size(); ++i) {
+        functionTiles[i] = tiles.find(evaluated[i / tilesPerFunction], level,
+                                      firstTile + i % tilesPerFunction, tileTolerance);
+        if (!functionTiles[i]) {
+            missing.push_back(i);
+        }
+    }
+    pool.parallelFor(missing.size(), [&](const size_t job) {
+        if (cancelled(sampling)) {
+            return;
+        }
+        const size_t i = missing[job];
+        const ParsedFunction* function = evaluated[i / tilesPerFunction];
+        const std::int64_t index = firstTile + i % tilesPerFunction;
+        auto tile = std::make_shared<SampleSeries>(step, index * TILE_SIZE, TILE_SIZE,
+                                                   singlePrecision);
+        if (sampling.visibleRange) {
+            evaluateCulledFunctionPoints(*function, 0, TILE_SIZE - 1, sampling, *tile);
+        } else {
+            evaluateFunctionPoints(*function, 0, TILE_SIZE - 1, sampling, *tile);
+        }
+        tiles.insert(function, level, index, tile, tileTolerance, sampling.tilesVersion);
+        functionTiles[i] = std::move(tile);
+    });
+    std::vector<SampleSeries> evaluatedSegments;
+    evaluatedSegments.reserve(evaluated.size());
+    for (size_t f = 0; f < evaluated.size(); ++f) {
+        SampleSeries& series = evaluatedSegments.emplace_back(step, origin, resolution,
+                                                              singlePrecision);
+        for (unsigned t = 0; t < tilesPerFunction; ++t) {
+            if (const TileCache::TilePtr& tile = functionTiles[f * tilesPerFunction + t]) {
+                series.copy(*tile);
+            }
+        }
+    }
+    return evaluatedSegments;
 }
 
-bool FunctionEvaluator::closeToBufferEnd(const Point* windowEnd) const {
-    return bufferSize() - (windowEnd - buffer) <= static_cast<unsigned>(std::round(
-               static_cast<double>(functions.size() * pointsPerFunction) *
-               MIN_CACHE_REEVALUATION_MARGIN));
+/**
+ * Evaluates the grid points first..last (inclusive), skipping the sub-domain when its
+ * enclosure lies outside of the visible range and interpolating it when the enclosure is
+ * flatter than the tolerance. Otherwise the sub-domain is halved until it is small enough to
+ * be evaluated directly.
+ */
+void FunctionEvaluator::evaluateCulledFunctionPoints(const ParsedFunction& function,
+                                                     const unsigned first, const unsigned last,
+                                                     const Sampling& sampling,
+                                                     SampleSeries& series) {
+    const double left = series.x(first);
+    const double right = series.x(last);
+    const std::optional<Interval> range = function.enclose(left, right);
+    if (!range) {
+        evaluateFunctionPoints(function, first, last, sampling, series);
+        return;
+    }
+    if (range->isEmpty() || range->upper < sampling.visibleRange->lower ||
+        sampling.visibleRange->upper < range->lower) {
+        series.markGaps(first, last + 1);
+        return;
+    }
+    if (range->defined && range->isFinite() &&
+        range->upper - range->lower <= sampling.tolerance) {
+        const double yLeft = function(left);
+        const double slope = first == last ? 0 : (function(right) - yLeft) / (last - first);
+        for (unsigned i = first; i <= last; ++i) {
+            series.store(i, yLeft + (i - first) * slope);
+        }
+        return;
+    }
+    if (last - first < CULLING_LEAF_SIZE) {
+        evaluateFunctionPoints(function, first, last, sampling, series);
+        return;
+    }
+    const unsigned middle = first + (last - first) / 2;
+    evaluateCulledFunctionPoints(function, first, middle, sampling, series);
+    evaluateCulledFunctionPoints(function, middle + 1, last, sampling, series);
 }
 
-bool FunctionEvaluator::closeToBufferStart(const Point* windowStart) const {
-    return windowStart - buffer <= static_cast<unsigned>(std::round(
-               static_cast<double>(functions.size() * pointsPerFunction) *
-               MIN_CACHE_REEVALUATION_MARGIN));
+void FunctionEvaluator::evaluateGridPoints(const ParsedFunction& function, const unsigned first,
+                                           const unsigned last, SampleSeries& series) {
+    double xs[EVALUATION_BLOCK_SIZE];
+    double ys[EVALUATION_BLOCK_SIZE];
+    for (unsigned i = first; i <= last;) {
+        const unsigned blockSize = std::min(EVALUATION_BLOCK_SIZE, last - i + 1);
+        for (unsigned j = 0; j < blockSize; ++j) {
+            xs[j] = series.x(i + j);
+        }
+        function.evaluate(xs, ys, blockSize);
+        series.store(i, ys, blockSize);
+        i += blockSize;
+    }
 }
 
-Rectangle FunctionEvaluator::calculateBounds(const Point* windowStart, const Point* windowEnd) {
-    double xMin = windowStart->x();
-    double xMax = windowStart->x();
-    double yMin = windowStart->y();
-    double yMax = windowStart->y();
-    for (const Point* p = windowStart + 1; p < windowEnd; ++p) {
-        if (p->x() < xMin) {
-            xMin = p->x();
-        } else if (p->x() > xMax) {
-            xMax = p->x();
+/**
+ * Evaluates the grid points first..last (inclusive), starting from every
+ * ADAPTIVE_INITIAL_STRIDE-th of them. Sub-domains are then halved in rounds, each evaluating
+ * the middles of all the sub-domains left in a single batch. A sub-domain is halved further if
+ * the function at its middle deviates from the chord of its ends by more than the tolerance, or
+ * if it is defined at some of these points only. When the next round would exceed the budget,
+ * only the sub-domains whose parents deviated the most are halved.
+ */
+void FunctionEvaluator::evaluateAdaptiveFunctionPoints(const ParsedFunction& function,
+                                                       const unsigned first,
+                                                       const unsigned last,
+                                                       const Sampling& sampling,
+                                                       SampleSeries& series) {
+    struct Span {
+        unsigned left;
+        unsigned right;
+        double deviation;
+    };
+
+    std::vector<double> values(last - first + 1);
+    std::vector<unsigned> indices;
+    const auto evaluateIndices = [&] {
+        double xs[EVALUATION_BLOCK_SIZE];
+        double ys[EVALUATION_BLOCK_SIZE];
+        for (size_t i = 0; i < indices.size(); i += EVALUATION_BLOCK_SIZE) {
+            const size_t blockSize = std::min<size_t>(EVALUATION_BLOCK_SIZE, indices.size() - i);
+            for (size_t j = 0; j < blockSize; ++j) {
+                xs[j] = series.x(indices[i + j]);
+            }
+            function.evaluate(xs, ys, blockSize);
+            for (size_t j = 0; j < blockSize; ++j) {
+                values[indices[i + j] - first] = ys[j];
+                series.store(indices[i + j], ys[j]);
+            }
+        }
+    };
+
+    for (unsigned i = first; i < last; i += ADAPTIVE_INITIAL_STRIDE) {
+        indices.push_back(i);
+    }
+    indices.push_back(last);
+    evaluateIndices();
+    const auto budget = std::max(indices.size(), static_cast<size_t>(
+                                     std::ceil((last - first + 1) * sampling.adaptiveBudget)));
+    size_t evaluatedCount = indices.size();
+    std::vector<Span> spans;
+    for (size_t i = 1; i < indices.size(); ++i) {
+        if (indices[i] - indices[i - 1] > 1) {
+            spans.push_back({indices[i - 1], indices[i], INFINITY});
+        }
+    }
+    while (!spans.empty() && evaluatedCount < budget) {
+        if (spans.size() > budget - evaluatedCount) {
+            std::stable_sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+                return a.deviation > b.deviation;
+            });
+            spans.resize(budget - evaluatedCount);
+        }
+        indices.clear();
+        for (const Span& span : spans) {
+            indices.push_back(span.left + (span.right - span.left) / 2);
         }
-        if (p->y() < yMin) {
-            yMin = p->y();
-        } else if (p->y() > yMax) {
-            yMax = p->y();
+        evaluateIndices();
+        evaluatedCount += indices.size();
+        std::vector<Span> halves;
+        for (const Span& span : spans) {
+            const unsigned middle = span.left + (span.right - span.left) / 2;
+            const double yLeft = values[span.left - first];
+            const double yMiddle = values[middle - first];
+            const double yRight = values[span.right - first];
+            const int finiteCount = std::isfinite(yLeft) + std::isfinite(yMiddle) +
+                                    std::isfinite(yRight);
+            double deviation = 0;
+            if (finiteCount == 3) {
+                deviation = std::abs(yMiddle - (yLeft + yRight) / 2);
+            } else if (finiteCount != 0) {
+                deviation = INFINITY;
+            }
+            if (deviation <= sampling.adaptiveTolerance) {
+                continue;
+            }
+            if (middle - span.left > 1) {
+                halves.push_back({span.left, middle, deviation});
+            }
+            if (span.right - middle > 1) {
+                halves.push_back({middle, span.right, deviation});
+            }
         }
+        spans = std::move(halves);
+    }
+}
+
+void FunctionEvaluator::evaluateFunctionPoints(const ParsedFunction& function,
+                                               const unsigned first, const unsigned last,
+                                               const Sampling& sampling, SampleSeries& series) {
+    if (sampling.adaptiveTolerance > 0) {
+        evaluateAdaptiveFunctionPoints(function, first, last, sampling, series);
+    } else {
+        evaluateGridPoints(function, first, last, series);
     }
-    return {xMax - xMin, yMax - yMin, Point(xMin, yMin)};
+}
+
+unsigned FunctionEvaluator::bufferSizeCoefficient() const {
+    return cachingEnabled ? BUFFER_SIZE_COEFFICIENT : 1;
+}
+
+/**
+ * Checks whether the window reaches within the reevaluation margin of either end of a range
+ * evaluated for a window of the same width
+ */
+bool FunctionEvaluator::closeToEdge(const double xMin, const double xMax, const double rangeMin,
+                                    const double rangeMax) const {
+    const double margin = (rangeMax - rangeMin) / bufferSizeCoefficient() *
+                          MIN_CACHE_REEVALUATION_MARGIN;
+    return xMin - rangeMin <= margin || rangeMax - xMax <= margin;
 }
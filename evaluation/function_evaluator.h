@@ -4,41 +4,177 @@
 
 #ifndef FUNCTION_EVALUATOR_H
 #define FUNCTION_EVALUATOR_H
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <optional>
 
 #include "parser/function_parser.h"
 #include "model/plot_model.h"
+#include "tile_cache.h"
+#include "util/thread_pool.h"
 
 
+/**
+ * Counters of the background prefetches of a FunctionEvaluator
+ * requested - prefetches requested by evaluate
+ * superseded - requests dropped, before or during their evaluation, because a newer request or
+ * a change of the evaluated functions made them obsolete
+ * completed - prefetched buffers that replaced the current one
+ * used - completed prefetches that served at least one evaluation
+ * wasted - completed prefetches replaced before serving any evaluation
+ */
+struct PrefetchStatistics {
+    size_t requested = 0;
+    size_t superseded = 0;
+    size_t completed = 0;
+    size_t used = 0;
+    size_t wasted = 0;
+};
+
 class FunctionEvaluator {
+    /**
+     * Parameters of an evaluation of the buffer, copied so that a background evaluation does
+     * not read the members the foreground modifies
+     * generation - generation of the evaluated prefetch, 0 for foreground evaluations
+     * tilesVersion - version of the tile cache the parameters were copied at
+     * adaptiveTolerance - tolerance of adaptive sampling, 0 for uniform sampling
+     * adaptiveBudget - maximal share of the grid points evaluated by adaptive sampling
+     */
+    struct Sampling {
+        std::optional<Interval> visibleRange;
+        double tolerance;
+        std::uint64_t generation;
+        std::uint64_t tilesVersion;
+        double adaptiveTolerance;
+        double adaptiveBudget;
+    };
+
+    /**
+     * Grid index of the first sample of the buffer to move to
+     */
+    struct PrefetchRequest {
+        std::int64_t origin;
+        std::uint64_t generation;
+    };
+
+    /**
+     * Samples of the functions, never modified once published
+     * functions - evaluated functions, in the order of the segments
+     * segments - samples of each function at the points origin, ..., origin + length - 1 of
+     * the grid of multiples of 2^level, which stays fixed while panning and zooming within
+     * a level; culled sub-domains and non-finite values are invalid samples
+     * pointsCount - number of points per window the grid was chosen for
+     * xMin, xMax - domain covered by the segments
+     */
+    struct Buffer {
+        std::vector<const ParsedFunction*> functions;
+        std::vector<std::shared_ptr<const SampleSeries>> segments;
+        int level;
+        std::int64_t origin;
+        unsigned length;
+        unsigned pointsCount;
+        double xMin;
+        double xMax;
+    };
+
     std::vector<const ParsedFunction*> functions;
-    Point* buffer = nullptr;
-    unsigned pointsPerFunction = 0;
+    /**
+     * The published buffer, nullptr while it needs reevaluation. Read and replaced only with
+     * std::atomic_load and std::atomic_store, so that evaluations read it without the lock;
+     * a replaced buffer is released with the last PlotData viewing it.
+     */
+    std::shared_ptr<const Buffer> buffer;
     bool cachingEnabled;
+    bool singlePrecision;
+    std::optional<Interval> visibleRange;
+    double tolerance = 0;
+    double adaptiveTolerance = 0;
+    double adaptiveBudget = 1;
     std::mutex semaphore;
+    /**
+     * Incremented by every prefetch request and by every change invalidating the requested
+     * prefetches; a prefetch of an older generation is dropped
+     */
+    std::atomic<std::uint64_t> generation = 0;
+    std::optional<PrefetchRequest> pendingPrefetch;
+    bool prefetchRunning = false;
+    /**
+     * Domain of the buffer the latest prefetch request produces
+     */
+    double prefetchXMin = INFINITY;
+    double prefetchXMax = -INFINITY;
+    bool prefetchUnread = false;
+    double lastXCenter = NAN;
+    int panDirection = 0;
+    PrefetchStatistics statistics;
+    TileCache tiles;
+    /**
+     * Declared last, so that it is destroyed first, while the state of its tasks still exists
+     */
+    ThreadPool pool;
+
+    static bool serves(const Buffer* current, double xMin, double xMax, int level,
+                       unsigned length, unsigned pointsCount);
+
+    static void view(const Buffer& current, double xMin, double xMax, PlotData& plotData);
+
+    void followWindow(const Buffer& current, double xMin, double xMax);
+
+    static std::int64_t alignedOrigin(double xMin, double xMax, int direction, int level,
+                                      unsigned length);
+
+    static std::pair<std::int64_t, unsigned> exposedRange(const Buffer* base, std::int64_t origin,
+                                                          unsigned length);
 
-    bool outOfBounds(double xMin, double xMax) const;
+    static std::shared_ptr<const Buffer> movedBuffer(Buffer moved, const Buffer* base,
+                                                     std::vector<SampleSeries> exposed);
 
-    size_t bufferSize() const;
+    bool closeToEdge(double xMin, double xMax, double rangeMin, double rangeMax) const;
 
-    static Rectangle calculateBounds(const Point* windowStart, const Point* windowEnd);
+    void requestPrefetch(const Buffer& current, double xMin, double xMax);
 
-    bool closeToBufferEnd(const Point* windowEnd) const;
+    void invalidatePrefetch();
 
-    bool rangeSmaller(double xMin, double xMax) const;
+    void prefetch();
 
-    bool closeToBufferStart(const Point* windowStart) const;
+    bool cancelled(const Sampling& sampling) const;
+
+    Sampling currentSampling(std::uint64_t prefetchGeneration) const;
 
     unsigned bufferSizeCoefficient() const;
 
-    static Point* evaluateSingleFunctionPoints(unsigned resolution, double xMin, double xMax,
-                                               const ParsedFunction& function, Point* bufferCursor);
+    static void evaluateGridPoints(const ParsedFunction& function, unsigned first, unsigned last,
+                                   SampleSeries& series);
+
+    static void evaluateAdaptiveFunctionPoints(const ParsedFunction& function, unsigned first,
+                                               unsigned last, const Sampling& sampling,
+                                               SampleSeries& series);
+
+    static void evaluateFunctionPoints(const ParsedFunction& function, unsigned first,
+                                       unsigned last, const Sampling& sampling,
+                                       SampleSeries& series);
+
+    static void evaluateCulledFunctionPoints(const ParsedFunction& function, unsigned first,
+                                             unsigned last, const Sampling& sampling,
+                                             SampleSeries& series);
+
+    std::vector<SampleSeries> evaluatePoints(const std::vector<const ParsedFunction*>& evaluated,
+                                             int level, std::int64_t origin, unsigned resolution,
+                                             const Sampling& sampling);
 
-    void calculateFunctionPoints(double xMin, double xMax, unsigned resolution) const;
+    std::shared_ptr<const Buffer> moveBuffer(double xMin, double xMax, int level,
+                                             unsigned length, unsigned pointsCount);
 
     public:
+        static constexpr double DEFAULT_ADAPTIVE_BUDGET = 0.25;
+
         /**
-         * @brief Evaluates cached function for pointsCount of points in the given domain
+         * @brief Evaluates cached function for pointsCount of points in the given domain.
+         * Unless the buffer has to be reevaluated, this neither copies the samples nor waits
+         * for the background evaluation.
          * @param xMin The left bound of the domain
          * @param xMax The right bound of the domain
          * @param pointsCount The number of points to evaluate
@@ -46,19 +182,75 @@ class FunctionEvaluator {
          */
         PlotData* evaluate(double xMin, double xMax, unsigned pointsCount);
 
+        /**
+         * @brief Evaluates as above into the given plot data, reusing its memory, so that a
+         * window the buffer already covers is evaluated without allocating
+         * @return false, leaving the plot data unchanged, if xMin >= xMax
+         */
+        bool evaluate(double xMin, double xMax, unsigned pointsCount, PlotData& plotData);
+
+        /**
+         * @return counters of the background prefetches
+         */
+        PrefetchStatistics prefetchStatistics();
+
+        /**
+         * @return counters of the cache of evaluated tiles
+         */
+        TileCacheStatistics tileCacheStatistics() const;
+
+        /**
+         * @brief Sets the memory available to the cache of evaluated tiles, which keeps samples
+         * of the functions across zoom levels
+         * @param budget maximal memory of the cached samples in bytes, 0 disables the cache
+         */
+        void setTileCacheBudget(size_t budget);
+
         /**
          * @brief Adds a function to the evaluator.
          * @param functionPtr function to add
          */
         void pushFunction(const ParsedFunction* functionPtr);
 
+        /**
+         * @brief Removes a function from the evaluator, along with its cached points.
+         * @param functionPtr function to remove, nothing happens if it is not evaluated
+         */
+        void removeFunction(const ParsedFunction* functionPtr);
+
+        /**
+         * @brief Enables culled evaluation. Functions able to bound their values are sampled on
+         * a fixed grid by recursive subdivision of the domain: sub-domains where the function
+         * provably stays outside of the visible range are skipped, and ones where it provably
+         * varies less than the tolerance are interpolated linearly from their ends.
+         * @param yMin The lower bound of the visible range
+         * @param yMax The upper bound of the visible range
+         * @param tolerance maximal acceptable error of a plotted value, e.g. half of a pixel
+         */
+        void setVisibleRange(double yMin, double yMax, double tolerance);
+
+        /**
+         * @brief Enables adaptive sampling. Each tile of the grid is sampled coarsely first, then
+         * sub-domains are halved only where the function at their middle deviates from the chord
+         * of their ends by more than the tolerance, until the budget is spent. Grid points left
+         * unevaluated are invalid samples, so the plot interpolates over them.
+         * @param tolerance maximal acceptable deviation from linear, e.g. half of a pixel; 0
+         * restores uniform sampling
+         * @param budget maximal share of the grid points to evaluate, in (0, 1]
+         */
+        void setAdaptiveSampling(double tolerance, double budget = DEFAULT_ADAPTIVE_BUDGET);
+
         /**
          * @brief Constructs a FunctionEvaluator with the given functions
-         * @param functions evaluated functions
+         * @param functions evaluated functions, called concurrently by the evaluating threads
          * @param cachingEnabled whether it should cache interval a bit bigger than requested for evaluation
+         * @param threadsCount number of evaluating threads, 0 for one per hardware thread
+         * @param singlePrecision whether to store the sampled values as float, halving the
+         * memory of the cache when the plot does not need double precision
          */
         explicit FunctionEvaluator(const std::vector<const ParsedFunction*>& functions,
-                                   bool cachingEnabled = false);
+                                   bool cachingEnabled = false, unsigned threadsCount = 0,
+                                   bool singlePrecision = false);
 
         /**
          * @return functions that are currently evaluated
@@ -66,9 +258,10 @@ class FunctionEvaluator {
         const std::vector<const ParsedFunction*>& parsedFunctions() const;
 
         /**
-         * @brief Computes the derivative of a function using finite differences.
+         * @brief Computes the derivative of a function, symbolically if the function supports it
+         * and using finite differences otherwise.
          * @param function function to compute the derivative of
-         * @param dx finite difference step size
+         * @param dx finite difference step size, used only when no symbolic derivative exists
          * @return ParsedFunction* representing the derivative of the function
          */
         static ParsedFunction* computeDerivative(const ParsedFunction* function, double dx);
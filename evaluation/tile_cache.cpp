@@ -0,0 +1,168 @@
+#include "tile_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+/**
+ * Number of finer levels searched for the samples of a missing tile
+ */
+static constexpr unsigned MAX_COARSENING_DEPTH = 2;
+
+TileCache::TileCache(const size_t budget): budget_(budget) { }
+
+TileCache::TilePtr TileCache::find(const ParsedFunction* function, const int level,
+                                   const std::int64_t index, const double tolerance) {
+    std::lock_guard lock(mutex);
+    const Key key{function, level, index};
+    if (TilePtr tile = lookup(key, tolerance).tile) {
+        ++statistics_.hits;
+        return tile;
+    }
+    if (TilePtr tile = coarsen(key, tolerance, MAX_COARSENING_DEPTH).tile) {
+        ++statistics_.coarsened;
+        return tile;
+    }
+    ++statistics_.misses;
+    return nullptr;
+}
+
+void TileCache::insert(const ParsedFunction* function, const int level, const std::int64_t index,
+                       TilePtr tile, const double tolerance, const std::uint64_t version) {
+    std::lock_guard lock(mutex);
+    if (version == version_) {
+        store({{function, level, index}, std::move(tile), tolerance});
+    }
+}
+
+void TileCache::erase(const ParsedFunction* function) {
+    std::lock_guard lock(mutex);
+    ++version_;
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        const auto next = std::next(entry);
+        if (entry->key.function == function) {
+            remove(entry);
+        }
+        entry = next;
+    }
+}
+
+void TileCache::clear() {
+    std::lock_guard lock(mutex);
+    ++version_;
+    index.clear();
+    entries.clear();
+    statistics_.bytes = 0;
+}
+
+std::uint64_t TileCache::version() const {
+    std::lock_guard lock(mutex);
+    return version_;
+}
+
+TileCacheStatistics TileCache::statistics() const {
+    std::lock_guard lock(mutex);
+    return statistics_;
+}
+
+size_t TileCache::budget() const {
+    std::lock_guard lock(mutex);
+    return budget_;
+}
+
+void TileCache::setBudget(const size_t budget) {
+    std::lock_guard lock(mutex);
+    budget_ = budget;
+    evict();
+}
+
+bool TileCache::Key::operator==(const Key& other) const {
+    return function == other.function && level == other.level && index == other.index;
+}
+
+size_t TileCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<const ParsedFunction*>()(key.function);
+    hash = hash * 31 + std::hash<int>()(key.level);
+    return hash * 31 + std::hash<std::int64_t>()(key.index);
+}
+
+TileCache::Entry TileCache::lookup(const Key& key, const double tolerance) {
+    const auto found = index.find(key);
+    if (found == index.end() || found->second->tolerance > tolerance) {
+        return {key, nullptr, 0};
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    return *found->second;
+}
+
+/**
+ * The samples of the tile are every second sample of the two tiles of the finer level covering
+ * it; these are looked up, or coarsened themselves, up to the given depth
+ */
+TileCache::Entry TileCache::coarsen(const Key& key, const double tolerance,
+                                    const unsigned depth) {
+    if (depth == 0) {
+        return {key, nullptr, 0};
+    }
+    Entry halves[2];
+    for (int half = 0; half < 2; ++half) {
+        const Key finer{key.function, key.level - 1, 2 * key.index + half};
+        halves[half] = lookup(finer, tolerance);
+        if (!halves[half].tile) {
+            halves[half] = coarsen(finer, tolerance, depth - 1);
+        }
+        if (!halves[half].tile) {
+            return {key, nullptr, 0};
+        }
+    }
+    auto tile = std::make_shared<SampleSeries>(std::ldexp(1.0, key.level), key.index * TILE_SIZE,
+                                               TILE_SIZE, halves[0].tile->singlePrecision());
+    for (size_t i = 0; i < TILE_SIZE; ++i) {
+        const SampleSeries& half = *halves[i * 2 / TILE_SIZE].tile;
+        const size_t finer = i * 2 % TILE_SIZE;
+        if (half.valid(finer)) {
+            tile->store(i, half.y(finer));
+        } else if (half.gap(finer)) {
+            tile->markGaps(i, i + 1);
+        }
+    }
+    Entry coarse{key, std::move(tile), std::max(halves[0].tolerance, halves[1].tolerance)};
+    store(coarse);
+    return coarse;
+}
+
+/**
+ * Replaces the cached entry of the key, if any, as the stored one was evaluated for the current
+ * parameters
+ */
+void TileCache::store(Entry entry) {
+    if (budget_ == 0) {
+        return;
+    }
+    if (const auto found = index.find(entry.key); found != index.end()) {
+        remove(found->second);
+    }
+    statistics_.bytes += bytes(*entry.tile);
+    entries.push_front(std::move(entry));
+    index.emplace(entries.front().key, entries.begin());
+    evict();
+}
+
+void TileCache::remove(const std::list<Entry>::iterator entry) {
+    statistics_.bytes -= bytes(*entry->tile);
+    index.erase(entry->key);
+    entries.erase(entry);
+}
+
+void TileCache::evict() {
+    while (statistics_.bytes > budget_ && !entries.empty()) {
+        remove(std::prev(entries.end()));
+        ++statistics_.evicted;
+    }
+}
+
+size_t TileCache::bytes(const SampleSeries& tile) {
+    const size_t valueSize = tile.singlePrecision() ? sizeof(float) : sizeof(double);
+    const size_t words = (tile.size() + SampleSeries::ALIGNMENT - 1) / SampleSeries::ALIGNMENT;
+    return tile.size() * valueSize + 2 * words * sizeof(std::uint64_t);
+}
@@ -0,0 +1,137 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "model/plot_model.h"
+
+/**
+ * Counters of a TileCache
+ * hits - requested tiles found in the cache
+ * coarsened - requested tiles assembled from cached tiles of finer levels
+ * misses - requested tiles that had to be evaluated
+ * evicted - tiles evicted to stay within the budget
+ * bytes - memory of the cached samples
+ */
+struct TileCacheStatistics {
+    size_t hits = 0;
+    size_t coarsened = 0;
+    size_t misses = 0;
+    size_t evicted = 0;
+    size_t bytes = 0;
+};
+
+/**
+ * A thread-safe cache of samples of functions on dyadic grids, in tiles of TILE_SIZE samples.
+ * The tile (function, level, index) holds the samples at x = (index * TILE_SIZE + i) * 2^level.
+ * Every point of a grid is a point of all the finer grids as well, so a tile missing at a level
+ * is assembled from the two tiles of the finer level covering it, if they are cached. Tiles of
+ * culled evaluations carry its tolerance and serve only requests tolerating as much error. The
+ * least recently used tiles are evicted once the cached samples take more than the budget.
+ */
+class TileCache {
+    public:
+        using TilePtr = std::shared_ptr<const SampleSeries>;
+
+        static constexpr size_t TILE_SIZE = 1024;
+
+        static constexpr size_t DEFAULT_BUDGET = 64 << 20;
+
+        /**
+         * @brief Constructs an empty cache
+         * @param budget maximal memory of the cached samples in bytes, 0 disables the cache
+         */
+        explicit TileCache(size_t budget = DEFAULT_BUDGET);
+
+        TileCache(const TileCache&) = delete;
+
+        TileCache& operator=(const TileCache&) = delete;
+
+        /**
+         * @brief Returns the cached tile, assembling it from finer levels if possible
+         * @param function sampled function
+         * @param level binary logarithm of the distance between the samples
+         * @param index index of the tile on the grid of the level
+         * @param tolerance maximal acceptable error of the samples, 0 for exact ones
+         * @return the tile, or nullptr on a miss
+         */
+        TilePtr find(const ParsedFunction* function, int level, std::int64_t index,
+                     double tolerance);
+
+        /**
+         * @brief Caches a tile, evicting the least recently used ones to stay within the budget
+         * @param tolerance maximal error of the samples of the tile
+         * @param version version of the cache the evaluation of the tile started at; the tile is
+         * dropped if any tiles were removed since, as it may have been evaluated for a removed
+         * function or with obsolete parameters
+         */
+        void insert(const ParsedFunction* function, int level, std::int64_t index, TilePtr tile,
+                    double tolerance, std::uint64_t version);
+
+        /**
+         * @brief Removes the tiles of a function
+         */
+        void erase(const ParsedFunction* function);
+
+        void clear();
+
+        /**
+         * @return number of removals of tiles by erase and clear
+         */
+        std::uint64_t version() const;
+
+        TileCacheStatistics statistics() const;
+
+        size_t budget() const;
+
+        void setBudget(size_t budget);
+
+    private:
+        struct Key {
+            const ParsedFunction* function;
+            int level;
+            std::int64_t index;
+
+            bool operator==(const Key& other) const;
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        struct Entry {
+            Key key;
+            TilePtr tile;
+            double tolerance;
+        };
+
+        mutable std::mutex mutex;
+        /**
+         * Most recently used entries first
+         */
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t budget_;
+        std::uint64_t version_ = 0;
+        TileCacheStatistics statistics_;
+
+        /**
+         * @return the entry, with a null tile on a miss
+         */
+        Entry lookup(const Key& key, double tolerance);
+
+        Entry coarsen(const Key& key, double tolerance, unsigned depth);
+
+        void store(Entry entry);
+
+        void remove(std::list<Entry>::iterator entry);
+
+        void evict();
+
+        static size_t bytes(const SampleSeries& tile);
+};
+
+#endif //TILE_CACHE_H
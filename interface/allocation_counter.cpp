@@ -0,0 +1,54 @@
+#include "allocation_counter.h"
+
+#ifdef PLOTTER2D_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+/** Allocations made by each thread, counted apart so that threads do not disturb each other */
+static thread_local size_t allocations = 0;
+
+size_t plotter2d::allocationCount() {
+    return allocations;
+}
+
+/**
+ * The other forms of operator new and delete, without alignment, are specified to forward to
+ * these ones
+ */
+void* operator new(const size_t size) {
+    ++allocations;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(const size_t size, const std::align_val_t alignment) {
+    ++allocations;
+    const auto bytes = static_cast<size_t>(alignment);
+    if (void* memory = std::aligned_alloc(bytes, (size + bytes - 1) / bytes * bytes)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+#else
+size_t plotter2d::allocationCount() {
+    return 0;
+}
+#endif
@@ -0,0 +1,17 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+#include <cstddef>
+
+namespace plotter2d {
+    /**
+     * @brief Counts the heap allocations made through operator new by the calling thread, so that
+     * a test can check that a code path does not allocate without counting the allocations other
+     * threads make meanwhile. The counting replaces the global operator new and delete, and is
+     * compiled in only with PLOTTER2D_COUNT_ALLOCATIONS defined.
+     * @return number of allocations made by the calling thread so far, always 0 without
+     * PLOTTER2D_COUNT_ALLOCATIONS
+     */
+    size_t allocationCount();
+}
+
+#endif //ALLOCATION_COUNTER_H
@@ -1,11 +1,24 @@
 #include "plotter2d.h"
+#include "parser/function_cache.h"
 #include "parser/parsed_function.h"
 #include "visualization/visualization.h"
 
+/**
+ * Functions given to plot may not be safe to call concurrently, so they are evaluated by a single
+ * thread unless the number of threads is set
+ */
+static plotter2d::Options serialByDefault(const plotter2d::Options& options) {
+    plotter2d::Options serialOptions = options;
+    if (serialOptions.threadsCount == 0) {
+        serialOptions.threadsCount = 1;
+    }
+    return serialOptions;
+}
+
 void plotter2d::plot(const std::function<double(double)>& func,
                      const std::pair<double, double>& domain, const Options& options) {
     const FunctionWrapper function(func);
-    Visualizer visualizer({&function}, domain.first, domain.second, options);
+    Visualizer visualizer({&function}, domain.first, domain.second, serialByDefault(options));
     visualizer.render();
 }
 
@@ -19,7 +32,7 @@ void plotter2d::plot(const std::vector<std::function<double(double)> >& funcs,
                        return new FunctionWrapper(func);
                    });
 
-    Visualizer visualizer(functions, domain.first, domain.second, options);
+    Visualizer visualizer(functions, domain.first, domain.second, serialByDefault(options));
     visualizer.render();
     for (const ParsedFunction* function : functions) {
         delete function;
@@ -30,50 +43,70 @@ void plotter2d::plot(const std::vector<std::function<double(double)> >& funcs,
 void plotter2d::plotFromPolishNotation(const std::string& polishNotation,
                                        const std::pair<double, double>& domain,
                                        const Options& options) {
-    FunctionParser parser;
-    const ParsedFunction* parsedFunction = parser.parsePolishNotation(polishNotation);
-    Visualizer visualizer({parsedFunction}, domain.first, domain.second, options);
+    const FunctionCache::FunctionPtr parsedFunction =
+        functionCache(options.jitEnabled, options.fastMathEnabled).get(polishNotation);
+    Visualizer visualizer({parsedFunction.get()}, domain.first, domain.second, options);
     visualizer.render();
-    delete parsedFunction;
 }
 
 void plotter2d::plotFromPolishNotation(const std::vector<std::string>& polishNotations,
                                        const std::pair<double, double>& domain,
                                        const Options& options) {
-    FunctionParser parser;
+    const std::vector<FunctionCache::FunctionPtr> cachedFunctions =
+        functionCache(options.jitEnabled, options.fastMathEnabled).getAll(polishNotations);
     std::vector<const ParsedFunction*> parsedFunctions;
 
-    for (const auto& notation : polishNotations) {
-        const ParsedFunction* parsedFunction = parser.parsePolishNotation(notation);
-        parsedFunctions.push_back(parsedFunction);
+    parsedFunctions.reserve(cachedFunctions.size());
+    for (const auto& function : cachedFunctions) {
+        parsedFunctions.push_back(function.get());
     }
 
     Visualizer visualizer(parsedFunctions, domain.first, domain.second, options);
     visualizer.render();
+}
 
-    for (const auto* func : parsedFunctions) {
-        delete func;
+FunctionCache& plotter2d::functionCache(const bool jitEnabled, const bool fastMathEnabled) {
+    using vector_math::Accuracy;
+    static FunctionCache interpretedFunctions(FunctionCache::DEFAULT_CAPACITY, false,
+                                              Accuracy::PRECISE);
+    static FunctionCache compiledFunctions(FunctionCache::DEFAULT_CAPACITY, true,
+                                           Accuracy::PRECISE);
+    static FunctionCache fastInterpretedFunctions(FunctionCache::DEFAULT_CAPACITY, false,
+                                                  Accuracy::FAST);
+    static FunctionCache fastCompiledFunctions(FunctionCache::DEFAULT_CAPACITY, true,
+                                               Accuracy::FAST);
+    if (fastMathEnabled) {
+        return jitEnabled ? fastCompiledFunctions : fastInterpretedFunctions;
     }
+    return jitEnabled ? compiledFunctions : interpretedFunctions;
 }
 
 
 plotter2d::Options::Options(): drawUi(true), drawAxes(true), drawGrid(true),
                                approximationMode(POINTS), resolution(5000), plotRange({}),
                                useCustomPlotRange(false), graphColor(0x000000FF),
-                               cachingEnabled(true) { }
+                               cachingEnabled(true), jitEnabled(false),
+                               fastMathEnabled(true), threadsCount(0), singlePrecision(false),
+                               tileCacheBudget(DEFAULT_TILE_CACHE_BUDGET),
+                               adaptiveSampling(false), frameRateLimit(0),
+                               printFrameStatistics(false) { }
 
 plotter2d::Options::Options(const bool drawUi, const bool drawAxes, const bool drawGrid,
                             const ApproximationMode approximationMode, const unsigned resolution,
                             const bool useCustomPlotRange,
                             const std::pair<double, double>& plotRange, const unsigned graphColor,
-                            const bool cachingEnabled) : drawUi(drawUi), drawAxes(drawAxes),
-                                                         drawGrid(drawGrid),
-                                                         approximationMode(approximationMode),
-                                                         resolution(resolution),
-                                                         plotRange(plotRange),
-                                                         useCustomPlotRange(useCustomPlotRange),
-                                                         graphColor(graphColor),
-                                                         cachingEnabled(cachingEnabled) { }
+                            const bool cachingEnabled, const bool jitEnabled,
+                            const bool fastMathEnabled, const unsigned threadsCount,
+                            const bool singlePrecision, const size_t tileCacheBudget,
+                            const bool adaptiveSampling, const unsigned frameRateLimit,
+                            const bool printFrameStatistics) :
+    drawUi(drawUi), drawAxes(drawAxes), drawGrid(drawGrid), approximationMode(approximationMode),
+    resolution(resolution), plotRange(plotRange), useCustomPlotRange(useCustomPlotRange),
+    graphColor(graphColor), cachingEnabled(cachingEnabled), jitEnabled(jitEnabled),
+    fastMathEnabled(fastMathEnabled), threadsCount(threadsCount),
+    singlePrecision(singlePrecision), tileCacheBudget(tileCacheBudget),
+    adaptiveSampling(adaptiveSampling), frameRateLimit(frameRateLimit),
+    printFrameStatistics(printFrameStatistics) { }
 
 plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::drawUi(const bool value) {
     drawUi_ = value;
@@ -126,6 +159,46 @@ plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::cachingEnabled(bool value)
     return *this;
 }
 
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::jitEnabled(bool value) {
+    jitEnabled_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::fastMathEnabled(bool value) {
+    fastMathEnabled_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::threadsCount(unsigned value) {
+    threadsCount_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::singlePrecision(bool value) {
+    singlePrecision_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::tileCacheBudget(size_t value) {
+    tileCacheBudget_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::adaptiveSampling(bool value) {
+    adaptiveSampling_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::frameRateLimit(unsigned value) {
+    frameRateLimit_ = value;
+    return *this;
+}
+
+plotter2d::OptionsBuilder& plotter2d::OptionsBuilder::printFrameStatistics(bool value) {
+    printFrameStatistics_ = value;
+    return *this;
+}
+
 plotter2d::Options plotter2d::OptionsBuilder::build() const {
     bool customPlotRange = useCustomPlotRange_;
     if (useCustomPlotRange_ && plotRange_ == std::pair<double, double>()) {
@@ -133,6 +206,8 @@ plotter2d::Options plotter2d::OptionsBuilder::build() const {
     }
     return {
         drawUi_, drawAxes_, drawGrid_, approximationMode_, resolution_, customPlotRange, plotRange_,
-        graphColor_, cachingEnabled_
+        graphColor_, cachingEnabled_, jitEnabled_, fastMathEnabled_, threadsCount_,
+        singlePrecision_, tileCacheBudget_, adaptiveSampling_, frameRateLimit_,
+        printFrameStatistics_
     };
 }
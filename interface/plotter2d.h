@@ -3,6 +3,7 @@
 #include <functional>
 #include <string>
 
+class FunctionCache;
 
 namespace plotter2d {
     struct Options {
@@ -19,13 +20,27 @@ namespace plotter2d {
         bool useCustomPlotRange;
         unsigned graphColor;
         bool cachingEnabled;
+        bool jitEnabled;
+        bool fastMathEnabled;
+        unsigned threadsCount;
+        bool singlePrecision;
+        size_t tileCacheBudget;
+        bool adaptiveSampling;
+        unsigned frameRateLimit;
+        bool printFrameStatistics;
+
+        static constexpr size_t DEFAULT_TILE_CACHE_BUDGET = 64 << 20;
 
         Options();
 
         Options(bool drawUi, bool drawAxes, bool drawGrid, ApproximationMode approximationMode,
                 unsigned resolution, bool useCustomPlotRange,
                 const std::pair<double, double>& plotRange, unsigned graphColor,
-                bool cachingEnabled);
+                bool cachingEnabled, bool jitEnabled = false, bool fastMathEnabled = true,
+                unsigned threadsCount = 0, bool singlePrecision = false,
+                size_t tileCacheBudget = DEFAULT_TILE_CACHE_BUDGET,
+                bool adaptiveSampling = false, unsigned frameRateLimit = 0,
+                bool printFrameStatistics = false);
 
     };
 
@@ -39,6 +54,14 @@ namespace plotter2d {
         std::pair<double, double> plotRange_{};
         bool useCustomPlotRange_ = false;
         bool cachingEnabled_ = true;
+        bool jitEnabled_ = false;
+        bool fastMathEnabled_ = true;
+        unsigned threadsCount_ = 0;
+        bool singlePrecision_ = false;
+        size_t tileCacheBudget_ = Options::DEFAULT_TILE_CACHE_BUDGET;
+        bool adaptiveSampling_ = false;
+        unsigned frameRateLimit_ = 0;
+        bool printFrameStatistics_ = false;
 
         public:
             OptionsBuilder& drawUi(bool value);
@@ -59,6 +82,55 @@ namespace plotter2d {
 
             OptionsBuilder& cachingEnabled(bool value);
 
+            OptionsBuilder& jitEnabled(bool value);
+
+            /**
+             * @brief Selects vectorized polynomial approximations of sin, cos, tan, exp and log
+             * in functions parsed from Polish notation, instead of the standard library
+             */
+            OptionsBuilder& fastMathEnabled(bool value);
+
+            /**
+             * @brief Sets the number of threads evaluating the plotted functions, 0 for the
+             * default: one per hardware thread for functions parsed from Polish notation, and a
+             * single thread for functions given to plot, which are called concurrently only if
+             * it is set above 1
+             */
+            OptionsBuilder& threadsCount(unsigned value);
+
+            /**
+             * @brief Stores the sampled values in single precision, which halves the memory of
+             * the cache. Suitable unless the plot zooms in on values varying far less than their
+             * magnitude.
+             */
+            OptionsBuilder& singlePrecision(bool value);
+
+            /**
+             * @brief Sets the memory, in bytes, of the cache keeping the sampled values across
+             * zoom levels, so that returning to a visited view reuses them. 0 disables it.
+             */
+            OptionsBuilder& tileCacheBudget(size_t value);
+
+            /**
+             * @brief Samples the functions densely only where they curve by more than half of a
+             * pixel, so that the resolution is spent on sharp features and flat parts cost few
+             * evaluations. Meant for the LINES approximation mode.
+             */
+            OptionsBuilder& adaptiveSampling(bool value);
+
+            /**
+             * @brief Sets the maximal number of frames drawn per second, 0 for no limit. The
+             * window is redrawn only when it changes, so the limit matters only while the plot
+             * is being zoomed or panned.
+             */
+            OptionsBuilder& frameRateLimit(unsigned value);
+
+            /**
+             * @brief Prints the number of frames drawn and their mean and longest times once
+             * the plot window is closed
+             */
+            OptionsBuilder& printFrameStatistics(bool value);
+
             Options build() const;
     };
 
@@ -77,6 +149,14 @@ namespace plotter2d {
     void plotFromPolishNotation(const std::vector<std::string>& polishNotations,
                                 const std::pair<double, double>& domain,
                                 const Options& options = Options());
+
+    /**
+     * @brief Gives access to the process-wide cache of functions parsed by plotFromPolishNotation
+     * @param jitEnabled whether to return the cache of natively compiled functions
+     * @param fastMathEnabled whether to return the cache of functions using fast approximations
+     * @return the cache
+     */
+    FunctionCache& functionCache(bool jitEnabled = false, bool fastMathEnabled = true);
 }
 
 #endif //PLOTTER2D_H
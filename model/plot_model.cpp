@@ -2,7 +2,22 @@
 
 #include <algorithm>
 #include <cmath>
-#include <cstring>
+#include <utility>
+
+#include "parser/simd.h"
+
+/**
+ * Positions of the samples in a block, used to map their x coordinates in vectors
+ */
+static const struct BlockPositions {
+    double positions[SampleSeries::ALIGNMENT];
+
+    BlockPositions() : positions() {
+        for (size_t i = 0; i < SampleSeries::ALIGNMENT; ++i) {
+            positions[i] = static_cast<double>(i);
+        }
+    }
+} BLOCK_POSITIONS;
 
 Point::Point() : x_(0), y_(0) { }
 
@@ -38,27 +53,456 @@ const Point& Rectangle::anchor() const {
     return anchor_;
 }
 
-PlotData::PlotData(const Rectangle& r, const Point* points, const size_t pointsCount)
-    : domain_(r), points_(new Point[pointsCount]), pointsCount_(pointsCount) {
-    std::memcpy(points_, points, sizeof(Point) * pointsCount);
+SampleSeries::PointIterator::PointIterator(const SampleSeries* series, const size_t index)
+    : series_(series), index_(index), previous_(series->size_), following_(0) {
+    if (index < series->size_) {
+        following_ = series->validWord(index / ALIGNMENT) & ~std::uint64_t{0} << index % ALIGNMENT;
+        ++*this;
+        previous_ = series->size_;
+    }
 }
 
-PlotData::~PlotData() {
-    delete[] points_;
+Point SampleSeries::PointIterator::operator*() const {
+    return series_->point(index_);
 }
 
-const Rectangle& PlotData::domain() const {
-    return domain_;
+/**
+ * Skips the invalid samples a word of the bitmap at a time
+ */
+SampleSeries::PointIterator& SampleSeries::PointIterator::operator++() {
+    previous_ = index_;
+    size_t word = index_ / ALIGNMENT;
+    while (following_ == 0) {
+        if (++word >= series_->validity_.size()) {
+            index_ = series_->size_;
+            return *this;
+        }
+        following_ = series_->validWord(word);
+    }
+    index_ = word * ALIGNMENT + __builtin_ctzll(following_);
+    following_ &= following_ - 1;
+    return *this;
+}
+
+bool SampleSeries::PointIterator::operator!=(const PointIterator& other) const {
+    return index_ != other.index_;
+}
+
+bool SampleSeries::PointIterator::gapBefore() const {
+    return previous_ < index_ && series_->hasGap(previous_ + 1, index_);
+}
+
+SampleSeries::SampleSeries() : SampleSeries(0, 0, 0, false) { }
+
+SampleSeries::SampleSeries(const double step, const std::int64_t origin, const size_t size,
+                           const bool singlePrecision)
+    : step_(step), origin_(origin), size_(size), head_(0), singlePrecision_(singlePrecision),
+      values_(singlePrecision ? 0 : size), singleValues_(singlePrecision ? size : 0),
+      validity_((size + ALIGNMENT - 1) / ALIGNMENT), gaps_(validity_.size()) { }
+
+size_t SampleSeries::size() const {
+    return size_;
+}
+
+std::int64_t SampleSeries::origin() const {
+    return origin_;
+}
+
+bool SampleSeries::singlePrecision() const {
+    return singlePrecision_;
+}
+
+double SampleSeries::x(const size_t i) const {
+    return static_cast<double>(origin_ + static_cast<std::int64_t>(i)) * step_;
+}
+
+double SampleSeries::y(const size_t i) const {
+    return singlePrecision_ ? singleValues_[position(i)] : values_[position(i)];
+}
+
+bool SampleSeries::valid(const size_t i) const {
+    return validWord(i / ALIGNMENT) >> i % ALIGNMENT & 1;
+}
+
+bool SampleSeries::gap(const size_t i) const {
+    return gaps_[wordPosition(i / ALIGNMENT)] >> i % ALIGNMENT & 1;
+}
+
+Point SampleSeries::point(const size_t i) const {
+    return {x(i), y(i)};
+}
+
+void SampleSeries::store(const size_t i, const double y) {
+    const bool finite = std::isfinite(y);
+    put(position(i), y, finite, !finite);
+}
+
+void SampleSeries::store(const size_t first, const double* ys, const size_t count) {
+    const size_t start = position(first);
+    const size_t run = std::min(count, size_ - start);
+    storeRun(start, ys, run);
+    storeRun(0, ys + run, count - run);
+}
+
+void SampleSeries::markGaps(const size_t first, const size_t last) {
+    for (size_t word = first / ALIGNMENT; word * ALIGNMENT < last; ++word) {
+        const std::uint64_t mask = rangeMask(word, first, last);
+        validity_[wordPosition(word)] &= ~mask;
+        gaps_[wordPosition(word)] |= mask;
+    }
+}
+
+size_t SampleSeries::validCount() const {
+    return validCount(0, size_);
+}
+
+size_t SampleSeries::validCount(const size_t first, const size_t last) const {
+    size_t count = 0;
+    for (size_t word = first / ALIGNMENT; word * ALIGNMENT < last; ++word) {
+        count += __builtin_popcountll(validWord(word) & rangeMask(word, first, last));
+    }
+    return count;
+}
+
+std::optional<Rectangle> SampleSeries::bounds() const {
+    return bounds(0, size_);
+}
+
+/**
+ * Words with all of their samples valid are scanned without testing the bits
+ */
+std::optional<Rectangle> SampleSeries::bounds(const size_t firstSample,
+                                              const size_t lastSample) const {
+    size_t first = size_;
+    size_t last = 0;
+    double yMin = INFINITY;
+    double yMax = -INFINITY;
+    for (size_t word = firstSample / ALIGNMENT; word * ALIGNMENT < lastSample; ++word) {
+        const std::uint64_t valid = validWord(word) & rangeMask(word, firstSample, lastSample);
+        if (valid == 0) {
+            continue;
+        }
+        first = std::min(first, word * ALIGNMENT + __builtin_ctzll(valid));
+        last = word * ALIGNMENT + ALIGNMENT - 1 - __builtin_clzll(valid);
+        const size_t start = wordPosition(word) * ALIGNMENT;
+        const size_t count = std::min(ALIGNMENT, size_ - word * ALIGNMENT);
+        if (singlePrecision_) {
+            extendRange(singleValues_, start, count, valid, yMin, yMax);
+        } else {
+            extendRange(values_, start, count, valid, yMin, yMax);
+        }
+    }
+    if (first == size_) {
+        return std::nullopt;
+    }
+    return Rectangle(x(last) - x(first), yMax - yMin, Point(x(first), yMin));
+}
+
+template<typename T>
+void SampleSeries::extendRange(const std::vector<T>& values, const size_t first,
+                               const size_t count, std::uint64_t valid, double& yMin,
+                               double& yMax) {
+    if (valid == ~std::uint64_t{0}) {
+        T low = values[first];
+        T high = values[first];
+        for (size_t i = first + 1; i < first + count; ++i) {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+        }
+        yMin = std::min<double>(yMin, low);
+        yMax = std::max<double>(yMax, high);
+        return;
+    }
+    for (; valid != 0; valid &= valid - 1) {
+        const T value = values[first + __builtin_ctzll(valid)];
+        yMin = std::min<double>(yMin, value);
+        yMax = std::max<double>(yMax, value);
+    }
+}
+
+/**
+ * The values of the block are converted to double first if they are stored as float, or if the
+ * block is the last, partial one
+ */
+void SampleSeries::mapBlock(const size_t block, const size_t first, const size_t last,
+                            const Mapping& mapping, MappedBlock& mapped) const {
+    const size_t start = wordPosition(block) * ALIGNMENT;
+    const size_t count = std::min(ALIGNMENT, size_ - block * ALIGNMENT);
+    const bool convert = singlePrecision_ || count < ALIGNMENT;
+    double converted[ALIGNMENT];
+    if (convert) {
+        for (size_t i = 0; i < ALIGNMENT; ++i) {
+            converted[i] = i >= count
+                               ? 0
+                               : singlePrecision_
+                                     ? singleValues_[start + i]
+                                     : values_[start + i];
+        }
+    }
+    // values_ is empty in single precision, so no pointer into it is formed then
+    const double* values = convert ? converted : values_.data() + start;
+    const simd::Vec xOffset = simd::broadcast((x(block * ALIGNMENT) - mapping.origin[0]) *
+                                              mapping.scale[0]);
+    const simd::Vec xScale = simd::broadcast(step_ * mapping.scale[0]);
+    const simd::Vec yOrigin = simd::broadcast(mapping.origin[1]);
+    const simd::Vec yScale = simd::broadcast(mapping.scale[1]);
+    const simd::Vec yLower = simd::broadcast(mapping.yLower);
+    const simd::Vec yUpper = simd::broadcast(mapping.yUpper);
+    std::uint64_t inRange = 0;
+    for (size_t i = 0; i < ALIGNMENT; i += simd::LANES) {
+        const simd::Vec y = simd::load(values + i);
+        simd::store(mapped.xs + i, simd::add(xOffset, simd::mul(
+                                                 simd::load(BLOCK_POSITIONS.positions + i),
+                                                 xScale)));
+        simd::store(mapped.ys + i, simd::mul(simd::sub(y, yOrigin), yScale));
+        const simd::Vec kept = simd::bitAnd(simd::lessEqual(yLower, y),
+                                            simd::lessEqual(y, yUpper));
+        inRange |= static_cast<std::uint64_t>(simd::bitmask(kept)) << i;
+    }
+    const std::uint64_t mask = rangeMask(block, first, last);
+    mapped.kept = validWord(block) & inRange & mask;
+    mapped.gaps = gaps_[wordPosition(block)] & mask;
+}
+
+/**
+ * Estimates the index from the grid and corrects it against the x coordinates as computed by
+ * x(i), which may differ from the estimate by rounding
+ */
+size_t SampleSeries::lowerIndex(const double x) const {
+    size_t i = 0;
+    if (step_ > 0) {
+        const double estimate = std::ceil(x / step_ - static_cast<double>(origin_));
+        i = static_cast<size_t>(std::clamp(estimate, 0.0, static_cast<double>(size_)));
+    }
+    while (i > 0 && this->x(i - 1) >= x) {
+        --i;
+    }
+    while (i < size_ && this->x(i) < x) {
+        ++i;
+    }
+    return i;
+}
+
+size_t SampleSeries::upperIndex(const double x) const {
+    size_t i = 0;
+    if (step_ > 0) {
+        const double estimate = std::floor(x / step_ - static_cast<double>(origin_)) + 1;
+        i = static_cast<size_t>(std::clamp(estimate, 0.0, static_cast<double>(size_)));
+    }
+    while (i > 0 && this->x(i - 1) > x) {
+        --i;
+    }
+    while (i < size_ && this->x(i) <= x) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * Only the head of the ring moves, and the bitmap words of the newly covered samples are cleared
+ */
+void SampleSeries::slide(const std::int64_t distance) {
+    origin_ += distance;
+    const auto length = static_cast<size_t>(distance < 0 ? -distance : distance);
+    if (length >= size_) {
+        head_ = 0;
+        std::fill(validity_.begin(), validity_.end(), 0);
+        std::fill(gaps_.begin(), gaps_.end(), 0);
+        return;
+    }
+    head_ = (head_ + (distance < 0 ? size_ - length : length)) % size_;
+    const size_t exposed = distance < 0 ? 0 : size_ - length;
+    for (size_t word = exposed / ALIGNMENT; word < (exposed + length) / ALIGNMENT; ++word) {
+        validity_[wordPosition(word)] = 0;
+        gaps_[wordPosition(word)] = 0;
+    }
 }
 
-const Point* PlotData::points() const {
-    return points_;
+void SampleSeries::copy(const SampleSeries& source) {
+    const std::int64_t first = std::max(origin_, source.origin_);
+    const std::int64_t last = std::min(origin_ + static_cast<std::int64_t>(size_),
+                                       source.origin_ + static_cast<std::int64_t>(source.size_));
+    for (std::int64_t g = first; g < last; ++g) {
+        const auto i = static_cast<size_t>(g - source.origin_);
+        put(position(static_cast<size_t>(g - origin_)), source.y(i), source.valid(i),
+            source.gap(i));
+    }
+}
+
+SampleSeries::PointIterator SampleSeries::begin() const {
+    return {this, 0};
+}
+
+SampleSeries::PointIterator SampleSeries::end() const {
+    return {this, size_};
+}
+
+size_t SampleSeries::position(const size_t i) const {
+    const size_t position = head_ + i;
+    return position < size_ ? position : position - size_;
+}
+
+size_t SampleSeries::wordPosition(const size_t word) const {
+    const size_t position = head_ / ALIGNMENT + word;
+    return position < validity_.size() ? position : position - validity_.size();
+}
+
+std::uint64_t SampleSeries::validWord(const size_t word) const {
+    return validity_[wordPosition(word)];
+}
+
+/**
+ * @return bits of the samples first, ..., last - 1 in the given word of the bitmap
+ */
+std::uint64_t SampleSeries::rangeMask(const size_t word, const size_t first, const size_t last) {
+    const size_t start = word * ALIGNMENT;
+    std::uint64_t mask = ~std::uint64_t{0};
+    if (first > start) {
+        mask &= ~std::uint64_t{0} << (first - start);
+    }
+    if (last < start + ALIGNMENT) {
+        mask &= ~(~std::uint64_t{0} << (last - start));
+    }
+    return mask;
+}
+
+bool SampleSeries::hasGap(const size_t first, const size_t last) const {
+    for (size_t word = first / ALIGNMENT; word * ALIGNMENT < last; ++word) {
+        if (gaps_[wordPosition(word)] & rangeMask(word, first, last)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SampleSeries::put(const size_t position, const double y, const bool valid,
+                       const bool gap) {
+    if (singlePrecision_) {
+        singleValues_[position] = static_cast<float>(y);
+    } else {
+        values_[position] = y;
+    }
+    const std::uint64_t bit = std::uint64_t{1} << position % ALIGNMENT;
+    std::uint64_t& validBits = validity_[position / ALIGNMENT];
+    std::uint64_t& gapBits = gaps_[position / ALIGNMENT];
+    validBits = valid ? validBits | bit : validBits & ~bit;
+    gapBits = gap ? gapBits | bit : gapBits & ~bit;
+}
+
+void SampleSeries::storeRun(const size_t position, const double* ys, const size_t count) {
+    if (singlePrecision_) {
+        std::copy(ys, ys + count, singleValues_.begin() + position);
+    } else {
+        std::copy(ys, ys + count, values_.begin() + position);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const std::uint64_t bit = std::uint64_t{1} << (position + i) % ALIGNMENT;
+        std::uint64_t& validBits = validity_[(position + i) / ALIGNMENT];
+        std::uint64_t& gapBits = gaps_[(position + i) / ALIGNMENT];
+        const bool finite = std::isfinite(ys[i]);
+        validBits = finite ? validBits | bit : validBits & ~bit;
+        gapBits = finite ? gapBits & ~bit : gapBits | bit;
+    }
+}
+
+SeriesView::SeriesView(std::shared_ptr<const SampleSeries> series, const size_t first,
+                       const size_t last)
+    : series_(std::move(series)), first_(first), last_(last) { }
+
+size_t SeriesView::validCount() const {
+    return series_->validCount(first_, last_);
+}
+
+std::optional<Rectangle> SeriesView::bounds() const {
+    return series_->bounds(first_, last_);
+}
+
+const SampleSeries& SeriesView::samples() const {
+    return *series_;
+}
+
+size_t SeriesView::first() const {
+    return first_;
+}
+
+size_t SeriesView::last() const {
+    return last_;
+}
+
+SampleSeries::PointIterator SeriesView::begin() const {
+    return {series_.get(), first_};
+}
+
+/**
+ * Iteration from begin visits exactly the valid samples before last, as it stops at the first
+ * valid sample not before it
+ */
+SampleSeries::PointIterator SeriesView::end() const {
+    return {series_.get(), last_};
+}
+
+PlotData::PlotData(const Rectangle& r, std::vector<SeriesView> series)
+    : domain_(r), series_(std::move(series)), pointsCount_(0) {
+    for (const SeriesView& functionSeries : series_) {
+        pointsCount_ += functionSeries.validCount();
+    }
+}
+
+PlotData::PlotData(): pointsCount_(0) { }
+
+/**
+ * Without a domain given, it is the smallest rectangle containing the valid samples, found on
+ * the first call, so that plot data whose domain is never read costs no pass over the samples
+ */
+const Rectangle& PlotData::domain() const {
+    if (domain_) {
+        return *domain_;
+    }
+    double xMin = INFINITY;
+    double xMax = -INFINITY;
+    double yMin = INFINITY;
+    double yMax = -INFINITY;
+    for (const SeriesView& functionSeries : series_) {
+        if (const std::optional<Rectangle> bounds = functionSeries.bounds()) {
+            xMin = std::min(xMin, bounds->anchor().x());
+            xMax = std::max(xMax, bounds->anchor().x() + bounds->width());
+            yMin = std::min(yMin, bounds->anchor().y());
+            yMax = std::max(yMax, bounds->anchor().y() + bounds->height());
+        }
+    }
+    if (xMin > xMax) {
+        return domain_.emplace(0, 0, Point(0, 0));
+    }
+    return domain_.emplace(xMax - xMin, yMax - yMin, Point(xMin, yMin));
 }
 
 size_t PlotData::pointsCount() const {
     return pointsCount_;
 }
 
+size_t PlotData::functionsCount() const {
+    return series_.size();
+}
+
+const SeriesView& PlotData::series(const size_t function) const {
+    return series_[function];
+}
+
+void PlotData::clear() {
+    series_.clear();
+    domain_.reset();
+    pointsCount_ = 0;
+}
+
+void PlotData::addSeries(std::shared_ptr<const SampleSeries> series, const size_t first,
+                         const size_t last) {
+    pointsCount_ += series_.emplace_back(std::move(series), first, last).validCount();
+}
+
+void PlotData::setDomain(const Rectangle& domain) {
+    domain_ = domain;
+}
+
 FunctionWrapper::FunctionWrapper(const std::function<double(double)>& func): func_(func) { }
 
 double FunctionWrapper::operator()(const double x) const {
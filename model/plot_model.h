@@ -1,7 +1,11 @@
 #ifndef PLOT_INTERFACE_H
 #define PLOT_INTERFACE_H
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "parser/parsed_function.h"
 
@@ -37,6 +41,8 @@ class Rectangle {
 
         Rectangle(const Rectangle&);
 
+        Rectangle& operator=(const Rectangle&) = default;
+
         Rectangle(const Point&, const Point&);
 
         double width() const;
@@ -46,31 +52,289 @@ class Rectangle {
         const Point& anchor() const;
 };
 
+/**
+ * Values of a function sampled on the grid x(i) = (origin + i) * step, stored without their x
+ * coordinates. Samples that were skipped or whose value is not finite are invalid; the values
+ * are kept in single precision if requested. The samples are stored in a ring, so that the
+ * series can slide along the grid keeping the samples it still covers.
+ * origin - The grid index of the first sample
+ * head - The position of the first sample in the ring
+ * validity - Bitmap of the valid samples by their position, 64 samples per word
+ * gaps - Bitmap of the invalid samples known not to be plottable, because their value is not
+ * finite or they were culled; a plotted line breaks at them, while it interpolates over the
+ * other invalid samples, which were not evaluated
+ */
+class SampleSeries {
+    double step_;
+    std::int64_t origin_;
+    size_t size_;
+    size_t head_;
+    bool singlePrecision_;
+    std::vector<double> values_;
+    std::vector<float> singleValues_;
+    std::vector<std::uint64_t> validity_;
+    std::vector<std::uint64_t> gaps_;
+
+    size_t position(size_t i) const;
+
+    size_t wordPosition(size_t word) const;
+
+    std::uint64_t validWord(size_t word) const;
+
+    static std::uint64_t rangeMask(size_t word, size_t first, size_t last);
+
+    bool hasGap(size_t first, size_t last) const;
+
+    void put(size_t position, double y, bool valid, bool gap);
+
+    void storeRun(size_t position, const double* ys, size_t count);
+
+    template<typename T>
+    static void extendRange(const std::vector<T>& values, size_t first, size_t count,
+                            std::uint64_t valid, double& yMin, double& yMax);
+
+    public:
+        /**
+         * Samples stored concurrently have to lie in different blocks of this many samples
+         */
+        static constexpr size_t ALIGNMENT = 64;
+
+        /**
+         * Iterates over the valid samples as points
+         */
+        class PointIterator {
+            const SampleSeries* series_;
+            size_t index_;
+            /**
+             * Index of the previous valid sample, size of the series at the first one
+             */
+            size_t previous_;
+            /**
+             * Bits of the valid samples following the current one in its word of the bitmap
+             */
+            std::uint64_t following_;
+
+            public:
+                /**
+                 * @brief Constructs an iterator at the first valid sample not before index
+                 */
+                PointIterator(const SampleSeries* series, size_t index);
+
+                Point operator*() const;
+
+                PointIterator& operator++();
+
+                bool operator!=(const PointIterator& other) const;
+
+                /**
+                 * @return whether a gap separates the sample from the previous valid one, so
+                 * that a line through the samples has to break before it
+                 */
+                bool gapBefore() const;
+        };
+
+        /**
+         * Affine map of the samples to the plane of a plot, taking a point (x, y) to
+         * ((x - origin[0]) * scale[0], (y - origin[1]) * scale[1]), and the range of y of the
+         * samples to keep
+         */
+        struct Mapping {
+            double origin[2];
+            double scale[2];
+            double yLower;
+            double yUpper;
+        };
+
+        /**
+         * A block of ALIGNMENT consecutive samples, starting at a multiple of ALIGNMENT, mapped
+         * to the plane of a plot
+         * xs, ys - The mapped coordinates, by the position of the sample in the block
+         * kept - Bits of the valid samples with y in the range of the mapping
+         * gaps - Bits of the gaps
+         */
+        struct MappedBlock {
+            double xs[ALIGNMENT];
+            double ys[ALIGNMENT];
+            std::uint64_t kept;
+            std::uint64_t gaps;
+        };
+
+        SampleSeries();
+
+        /**
+         * @brief Constructs a series of invalid samples
+         * @param step The distance between consecutive points of the grid
+         * @param origin The grid index of the first sample
+         * @param size The number of samples
+         * @param singlePrecision whether to store the values as float
+         */
+        SampleSeries(double step, std::int64_t origin, size_t size, bool singlePrecision);
+
+        size_t size() const;
+
+        std::int64_t origin() const;
+
+        bool singlePrecision() const;
+
+        double x(size_t i) const;
+
+        double y(size_t i) const;
+
+        bool valid(size_t i) const;
+
+        bool gap(size_t i) const;
+
+        Point point(size_t i) const;
+
+        /**
+         * @brief Stores the value of a sample, marking it valid if the value is finite
+         */
+        void store(size_t i, double y);
+
+        /**
+         * @brief Stores the values of the samples first, ..., first + count - 1
+         */
+        void store(size_t first, const double* ys, size_t count);
+
+        /**
+         * @brief Marks the samples first, ..., last - 1 as invalid gaps
+         */
+        void markGaps(size_t first, size_t last);
+
+        size_t validCount() const;
+
+        /**
+         * @return number of the valid samples among first, ..., last - 1
+         */
+        size_t validCount(size_t first, size_t last) const;
+
+        /**
+         * @return the smallest rectangle containing the valid samples, nothing if there are none
+         */
+        std::optional<Rectangle> bounds() const;
+
+        /**
+         * @return the smallest rectangle containing the valid samples among first, ..., last - 1,
+         * nothing if there are none
+         */
+        std::optional<Rectangle> bounds(size_t first, size_t last) const;
+
+        /**
+         * @return index of the first sample with x not smaller than the given one
+         */
+        size_t lowerIndex(double x) const;
+
+        /**
+         * @return index of the first sample with x greater than the given one
+         */
+        size_t upperIndex(double x) const;
+
+        /**
+         * @brief Moves the series along the grid, keeping the samples it still covers, in time
+         * proportional to the distance. The samples it newly covers are invalid.
+         * @param distance number of grid points to move by, a multiple of ALIGNMENT, as has to
+         * be the size of the series
+         */
+        void slide(std::int64_t distance);
+
+        /**
+         * @brief Copies the samples of a series on the same grid where the two overlap
+         * @param source series to copy from
+         */
+        void copy(const SampleSeries& source);
+
+        /**
+         * @brief Maps a block of samples to the plane of a plot, filtering them by y, in a single
+         * vectorized pass over their values
+         * @param block index of the block, covering the samples from block * ALIGNMENT on
+         * @param first the first sample to map
+         * @param last the sample after the last one to map
+         * @param mapping the map and the range of y to keep
+         * @param mapped the mapped block; the bits of the samples outside first, ..., last - 1
+         * are cleared
+         */
+        void mapBlock(size_t block, size_t first, size_t last, const Mapping& mapping,
+                      MappedBlock& mapped) const;
+
+        PointIterator begin() const;
+
+        PointIterator end() const;
+};
+
+/**
+ * The samples first, ..., last - 1 of a series that is never modified again, shared by all of
+ * its views and released with the last one
+ */
+class SeriesView {
+    std::shared_ptr<const SampleSeries> series_;
+    size_t first_;
+    size_t last_;
+
+    public:
+        SeriesView(std::shared_ptr<const SampleSeries> series, size_t first, size_t last);
+
+        const SampleSeries& samples() const;
+
+        size_t first() const;
+
+        size_t last() const;
+
+        size_t validCount() const;
+
+        /**
+         * @return the smallest rectangle containing the valid samples, nothing if there are none
+         */
+        std::optional<Rectangle> bounds() const;
+
+        SampleSeries::PointIterator begin() const;
+
+        SampleSeries::PointIterator end() const;
+};
+
 /**
  * A set of points to be plotted on a 2D plane
- * domain - The domain of the plot (a rectangle containing all points)
- * points - The array of points to plot
- * pointsCount - The number of points in the array
+ * domain - The domain of the plot (a rectangle containing all points), found from the samples
+ * when first read unless given
+ * series - The samples of each function
+ * pointsCount - The number of valid samples
  */
 class PlotData {
-    Rectangle domain_;
-    Point* points_;
+    mutable std::optional<Rectangle> domain_;
+    std::vector<SeriesView> series_;
     size_t pointsCount_;
 
     public:
-        PlotData(const Rectangle&, const Point*, size_t);
+        PlotData(const Rectangle&, std::vector<SeriesView> series);
+
+        /**
+         * @brief Constructs empty plot data, to be filled by a FunctionEvaluator
+         */
+        PlotData();
 
         PlotData(const PlotData&) = delete;
 
         PlotData& operator=(const PlotData&) = delete;
 
-        ~PlotData();
-
         const Rectangle& domain() const;
 
-        const Point* points() const;
-
         size_t pointsCount() const;
+
+        size_t functionsCount() const;
+
+        /**
+         * @param function index of the function
+         * @return the samples of the function, iterable as points sorted by x
+         */
+        const SeriesView& series(size_t function) const;
+
+        /**
+         * @brief Removes all the series, keeping the memory for the next ones
+         */
+        void clear();
+
+        void addSeries(std::shared_ptr<const SampleSeries> series, size_t first, size_t last);
+
+        void setDomain(const Rectangle& domain);
 };
 
 
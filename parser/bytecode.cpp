@@ -0,0 +1,606 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "simd.h"
+
+namespace {
+    constexpr std::uint32_t NO_SLOT = UINT32_MAX;
+
+    Bytecode::OpCode opCode(const Expression::Kind kind) {
+        switch (kind) {
+            case Expression::Kind::ADD:
+                return Bytecode::OpCode::ADD;
+            case Expression::Kind::SUBTRACT:
+                return Bytecode::OpCode::SUBTRACT;
+            case Expression::Kind::MULTIPLY:
+                return Bytecode::OpCode::MULTIPLY;
+            case Expression::Kind::DIVIDE:
+                return Bytecode::OpCode::DIVIDE;
+            case Expression::Kind::POWER:
+                return Bytecode::OpCode::POWER;
+            case Expression::Kind::SIN:
+                return Bytecode::OpCode::SIN;
+            case Expression::Kind::COS:
+                return Bytecode::OpCode::COS;
+            case Expression::Kind::TAN:
+                return Bytecode::OpCode::TAN;
+            case Expression::Kind::EXP:
+                return Bytecode::OpCode::EXP;
+            case Expression::Kind::LOG:
+                return Bytecode::OpCode::LOG;
+            case Expression::Kind::SQRT:
+                return Bytecode::OpCode::SQRT;
+            case Expression::Kind::ABS:
+                return Bytecode::OpCode::ABS;
+            default:
+                throw std::invalid_argument("Invalid expression");
+        }
+    }
+
+    bool integerExponent(const Expression& expression, const Expression::Index index,
+                         int& exponent) {
+        if (!expression.isConstant(index)) {
+            return false;
+        }
+        const double value = expression.value(index);
+        if (std::trunc(value) != value || std::abs(value) > Bytecode::MAX_INTEGER_POWER) {
+            return false;
+        }
+        exponent = static_cast<int>(value);
+        return true;
+    }
+
+    bool isMonomial(const std::vector<double>& polynomial) {
+        return std::count(polynomial.begin(), polynomial.end(), 0.0) + 1 >=
+               static_cast<std::ptrdiff_t>(polynomial.size());
+    }
+
+    /**
+     * Multiplying out a product of polynomials trades the relative accuracy of the factors for
+     * an absolute error proportional to the sum of |c_i x^i|, which near the roots of shifted
+     * polynomials such as (x - 1000)^2 exceeds their value, so a product is expanded only when
+     * one of its factors is a monomial, which multiplying out keeps exact
+     */
+    bool expandable(const std::vector<double>& a, const std::vector<double>& b) {
+        return a.size() + b.size() - 2 <= Bytecode::MAX_POLYNOMIAL_DEGREE &&
+               (isMonomial(a) || isMonomial(b));
+    }
+
+    std::vector<double> multiply(const std::vector<double>& a, const std::vector<double>& b) {
+        std::vector<double> product(a.size() + b.size() - 1);
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < b.size(); ++j) {
+                product[i + j] += a[i] * b[j];
+            }
+        }
+        return product;
+    }
+
+    /**
+     * @brief Evaluates a polynomial with the first level of Estrin's scheme:
+     * p(x) = E(x^2) + x * O(x^2), with E and O of even and odd coefficients evaluated by Horner's
+     * rule as two independent chains of operations. Each chain starts from its highest nonzero
+     * coefficient, so that no zero is multiplied by an overflowed x^2 into NaN. Rounds exactly as
+     * the vector version and the native code do.
+     */
+    double estrin(const double x, const double* coefficients,
+                  const Bytecode::Polynomial& polynomial) {
+        const size_t evenSteps = polynomial.evenDegree / 2;
+        const size_t oddSteps = polynomial.oddDegree / 2;
+        const double square = x * x;
+        double evenPart = coefficients[polynomial.evenDegree];
+        double oddPart = coefficients[polynomial.oddDegree];
+        for (size_t step = std::max(evenSteps, oddSteps); step >= 1; --step) {
+            if (step <= evenSteps) {
+                evenPart = evenPart * square + coefficients[2 * step - 2];
+            }
+            if (step <= oddSteps) {
+                oddPart = oddPart * square + coefficients[2 * step - 1];
+            }
+        }
+        return polynomial.oddDegree == 0 ? evenPart : evenPart + oddPart * x;
+    }
+
+    /**
+     * @brief Replaces vectors of arguments with the values of a polynomial, as the scalar
+     * version does. The 2 * VECTORS chains keep the arithmetic units busy, which the further
+     * levels of Estrin's scheme would not improve on for the degrees of plotted polynomials.
+     */
+    template <size_t VECTORS>
+    void estrin(double* values, const double* coefficients,
+                const Bytecode::Polynomial& polynomial) {
+        const size_t evenSteps = polynomial.evenDegree / 2;
+        const size_t oddSteps = polynomial.oddDegree / 2;
+        simd::Vec x[VECTORS], square[VECTORS], evenPart[VECTORS], oddPart[VECTORS];
+        for (size_t i = 0; i < VECTORS; ++i) {
+            x[i] = simd::load(values + i * simd::LANES);
+            square[i] = simd::mul(x[i], x[i]);
+            evenPart[i] = simd::broadcast(coefficients[polynomial.evenDegree]);
+            oddPart[i] = simd::broadcast(coefficients[polynomial.oddDegree]);
+        }
+        for (size_t step = std::max(evenSteps, oddSteps); step >= 1; --step) {
+            const simd::Vec evenCoefficient = simd::broadcast(coefficients[2 * step - 2]);
+            const simd::Vec oddCoefficient = simd::broadcast(coefficients[2 * step - 1]);
+            for (size_t i = 0; i < VECTORS; ++i) {
+                if (step <= evenSteps) {
+                    evenPart[i] = simd::add(simd::mul(evenPart[i], square[i]), evenCoefficient);
+                }
+                if (step <= oddSteps) {
+                    oddPart[i] = simd::add(simd::mul(oddPart[i], square[i]), oddCoefficient);
+                }
+            }
+        }
+        for (size_t i = 0; i < VECTORS; ++i) {
+            simd::store(values + i * simd::LANES,
+                        polynomial.oddDegree == 0
+                            ? evenPart[i]
+                            : simd::add(evenPart[i], simd::mul(oddPart[i], x[i])));
+        }
+    }
+
+    /**
+     * Left-to-right binary exponentiation, the same sequence of multiplications the native code
+     * performs
+     */
+    template <typename T, typename Multiply, typename Divide>
+    T integerPower(const T x, const int exponent, Multiply multiply, Divide divide, const T one) {
+        const unsigned magnitude = static_cast<unsigned>(std::abs(exponent));
+        if (magnitude == 0) {
+            return one;
+        }
+        T result = x;
+        for (int bit = 30 - __builtin_clz(magnitude); bit >= 0; --bit) {
+            result = multiply(result, result);
+            if (magnitude >> bit & 1) {
+                result = multiply(result, x);
+            }
+        }
+        return exponent < 0 ? divide(one, result) : result;
+    }
+
+    double multiplyScalars(const double a, const double b) {
+        return a * b;
+    }
+
+    double divideScalars(const double a, const double b) {
+        return a / b;
+    }
+
+    template <typename Operation>
+    void combineLanes(double* a, const double* b, const size_t lanes, Operation operation) {
+        for (size_t i = 0; i < lanes; i += simd::LANES) {
+            simd::store(a + i, operation(simd::load(a + i), simd::load(b + i)));
+        }
+    }
+}
+
+Bytecode Bytecode::compile(const Expression& expression, const vector_math::Accuracy accuracy) {
+    std::vector<unsigned> uses(expression.size());
+    const std::vector<bool> reachable = expression.reachable();
+    for (Expression::Index i = 0; i < expression.size(); ++i) {
+        const Expression::Node& node = expression.node(i);
+        if (reachable[i] && node.kind != Expression::Kind::CONSTANT &&
+            node.kind != Expression::Kind::VARIABLE) {
+            ++uses[node.left];
+            if (!Expression::isFunction(node.kind)) {
+                ++uses[node.right];
+            }
+        }
+    }
+    Bytecode program;
+    program.accuracy_ = accuracy;
+    program.instructions_.reserve(2 * expression.size());
+    program.constants_.reserve(expression.size());
+    std::vector<std::uint32_t> slots(expression.size(), NO_SLOT);
+    program.emit(expression, expression.root(), uses, expandPolynomials(expression, reachable),
+                 slots);
+    return program;
+}
+
+/**
+ * @return coefficients of every reachable node that is a polynomial of the variable not
+ * exceeding the degree limits, an empty vector for other nodes
+ */
+std::vector<std::vector<double> > Bytecode::expandPolynomials(
+    const Expression& expression, const std::vector<bool>& reachable) {
+    std::vector<std::vector<double> > expansions(expression.size());
+    for (Expression::Index i = 0; i < expression.size(); ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const Expression::Node& node = expression.node(i);
+        std::vector<double>& expansion = expansions[i];
+        const std::vector<double>& left = expansions[node.left];
+        const std::vector<double>& right = expansions[node.right];
+        const bool operands = !left.empty() && !right.empty();
+        int exponent = 0;
+        switch (node.kind) {
+            case Expression::Kind::CONSTANT:
+                expansion = {expression.value(i)};
+                break;
+            case Expression::Kind::VARIABLE:
+                expansion = {0.0, 1.0};
+                break;
+            case Expression::Kind::ADD:
+            case Expression::Kind::SUBTRACT:
+                if (operands) {
+                    const double sign = node.kind == Expression::Kind::ADD ? 1 : -1;
+                    expansion.assign(std::max(left.size(), right.size()), 0.0);
+                    std::copy(left.begin(), left.end(), expansion.begin());
+                    for (size_t j = 0; j < right.size(); ++j) {
+                        expansion[j] += sign * right[j];
+                    }
+                }
+                break;
+            case Expression::Kind::MULTIPLY:
+                if (operands && expandable(left, right)) {
+                    expansion = multiply(left, right);
+                }
+                break;
+            case Expression::Kind::DIVIDE:
+                // a division by zero is left to the DIVIDE opcode, to give infinities
+                if (operands && right.size() == 1 && right[0] != 0) {
+                    expansion = left;
+                    for (double& coefficient : expansion) {
+                        coefficient /= right[0];
+                    }
+                }
+                break;
+            case Expression::Kind::POWER:
+                // a power of another polynomial is left to INTEGER_POWER, multiplying its value
+                if (!left.empty() && integerExponent(expression, node.right, exponent) &&
+                    exponent >= 0 && (exponent <= 1 || isMonomial(left))) {
+                    expansion = {1.0};
+                    for (int j = 0; j < exponent && !expansion.empty(); ++j) {
+                        expansion = expandable(expansion, left)
+                                        ? multiply(expansion, left)
+                                        : std::vector<double>();
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+        while (expansion.size() > 1 && expansion.back() == 0) {
+            expansion.pop_back();
+        }
+    }
+    return expansions;
+}
+
+void Bytecode::pushConstant(const double value) {
+    instructions_.push_back({OpCode::PUSH_CONSTANT, static_cast<std::uint32_t>(constants_.size())});
+    constants_.push_back(value);
+    maxDepth_ = std::max(maxDepth_, ++depth_);
+}
+
+void Bytecode::pushVariable() {
+    instructions_.push_back({OpCode::PUSH_VARIABLE, 0});
+    maxDepth_ = std::max(maxDepth_, ++depth_);
+}
+
+void Bytecode::pushPolynomial(const std::vector<double>& coefficients) {
+    if (coefficients.empty() || coefficients.size() > MAX_POLYNOMIAL_DEGREE + 1) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    instructions_.push_back({OpCode::PUSH_POLYNOMIAL,
+                             static_cast<std::uint32_t>(polynomials_.size())});
+    Polynomial polynomial{static_cast<std::uint32_t>(constants_.size()),
+                          static_cast<std::uint32_t>(coefficients.size() - 1), 0, 0};
+    for (std::uint32_t power = 1; power <= polynomial.degree; ++power) {
+        if (coefficients[power] != 0) {
+            (power % 2 == 0 ? polynomial.evenDegree : polynomial.oddDegree) = power;
+        }
+    }
+    polynomials_.push_back(polynomial);
+    constants_.insert(constants_.end(), coefficients.begin(), coefficients.end());
+    maxDepth_ = std::max(maxDepth_, ++depth_);
+}
+
+void Bytecode::pushIntegerPower(const int exponent) {
+    if (depth_ < 1 || std::abs(exponent) > MAX_INTEGER_POWER) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    instructions_.push_back({OpCode::INTEGER_POWER, static_cast<std::uint32_t>(exponent)});
+}
+
+void Bytecode::pushStore(const std::uint32_t slot) {
+    if (depth_ < 1) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    instructions_.push_back({OpCode::STORE, slot});
+    temporaries_ = std::max<size_t>(temporaries_, slot + 1);
+}
+
+void Bytecode::pushLoad(const std::uint32_t slot) {
+    if (slot >= temporaries_) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    instructions_.push_back({OpCode::LOAD, slot});
+    maxDepth_ = std::max(maxDepth_, ++depth_);
+}
+
+void Bytecode::pushOperation(const OpCode opCode) {
+    if (depth_ < (isFunction(opCode) ? 1 : 2) || opCode == OpCode::PUSH_CONSTANT ||
+        opCode == OpCode::PUSH_VARIABLE || opCode == OpCode::PUSH_POLYNOMIAL ||
+        opCode == OpCode::STORE || opCode == OpCode::LOAD || opCode == OpCode::INTEGER_POWER) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    instructions_.push_back({opCode, 0});
+    if (!isFunction(opCode)) {
+        --depth_;
+    }
+}
+
+double Bytecode::operator()(const double x) const {
+    if (depth_ != 1) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    if (maxDepth_ + temporaries_ <= INLINE_STACK_SIZE) {
+        double stack[INLINE_STACK_SIZE];
+        return run(x, stack, stack + maxDepth_);
+    }
+    std::vector<double> stack(maxDepth_ + temporaries_);
+    return run(x, stack.data(), stack.data() + maxDepth_);
+}
+
+void Bytecode::operator()(const double* xs, double* ys, const size_t count) const {
+    if (depth_ != 1) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    std::vector<double> stack((maxDepth_ + temporaries_) * BLOCK_SIZE);
+    double* temporaries = stack.data() + maxDepth_ * BLOCK_SIZE;
+    for (size_t offset = 0; offset < count; offset += BLOCK_SIZE) {
+        runBlock(xs + offset, ys + offset, std::min(BLOCK_SIZE, count - offset), stack.data(),
+                 temporaries);
+    }
+}
+
+const std::vector<Bytecode::Instruction>& Bytecode::instructions() const {
+    return instructions_;
+}
+
+const std::vector<double>& Bytecode::constants() const {
+    return constants_;
+}
+
+const std::vector<Bytecode::Polynomial>& Bytecode::polynomials() const {
+    return polynomials_;
+}
+
+size_t Bytecode::stackDepth() const {
+    return maxDepth_;
+}
+
+size_t Bytecode::temporaries() const {
+    return temporaries_;
+}
+
+vector_math::Accuracy Bytecode::accuracy() const {
+    return accuracy_;
+}
+
+bool Bytecode::isFunction(const OpCode opCode) {
+    return opCode >= OpCode::SIN;
+}
+
+void Bytecode::emit(const Expression& expression, const Expression::Index index,
+                    const std::vector<unsigned>& uses,
+                    const std::vector<std::vector<double> >& expansions,
+                    std::vector<std::uint32_t>& slots) {
+    if (slots[index] != NO_SLOT) {
+        pushLoad(slots[index]);
+        return;
+    }
+    const Expression::Node& node = expression.node(index);
+    const std::vector<double>& expansion = expansions[index];
+    int exponent = 0;
+    switch (node.kind) {
+        case Expression::Kind::CONSTANT:
+            pushConstant(expression.value(index));
+            return;
+        case Expression::Kind::VARIABLE:
+            pushVariable();
+            return;
+        default:
+            if (expansion.size() == 1) {
+                pushConstant(expansion[0]);
+            } else if (expansion.size() > 2 && isMonomial(expansion)) {
+                pushVariable();
+                pushIntegerPower(static_cast<int>(expansion.size() - 1));
+                if (expansion.back() != 1) {
+                    pushConstant(expansion.back());
+                    pushOperation(OpCode::MULTIPLY);
+                }
+            } else if (!expansion.empty()) {
+                pushPolynomial(expansion);
+            } else if (node.kind == Expression::Kind::POWER &&
+                       integerExponent(expression, node.right, exponent)) {
+                emit(expression, node.left, uses, expansions, slots);
+                pushIntegerPower(exponent);
+            } else {
+                emit(expression, node.left, uses, expansions, slots);
+                if (!Expression::isFunction(node.kind)) {
+                    emit(expression, node.right, uses, expansions, slots);
+                }
+                pushOperation(opCode(node.kind));
+            }
+    }
+    if (uses[index] > 1) {
+        slots[index] = static_cast<std::uint32_t>(temporaries_);
+        pushStore(slots[index]);
+    }
+}
+
+double Bytecode::run(const double x, double* stack, double* temporaries) const {
+    double* top = stack - 1;
+    const double* constants = constants_.data();
+    for (const Instruction& instruction : instructions_) {
+        switch (instruction.opCode) {
+            case OpCode::PUSH_CONSTANT:
+                *++top = constants[instruction.operand];
+                break;
+            case OpCode::PUSH_VARIABLE:
+                *++top = x;
+                break;
+            case OpCode::STORE:
+                temporaries[instruction.operand] = *top;
+                break;
+            case OpCode::LOAD:
+                *++top = temporaries[instruction.operand];
+                break;
+            case OpCode::ADD:
+                --top;
+                top[0] += top[1];
+                break;
+            case OpCode::SUBTRACT:
+                --top;
+                top[0] -= top[1];
+                break;
+            case OpCode::MULTIPLY:
+                --top;
+                top[0] *= top[1];
+                break;
+            case OpCode::DIVIDE:
+                --top;
+                top[0] /= top[1];
+                break;
+            case OpCode::POWER:
+                --top;
+                top[0] = std::pow(top[0], top[1]);
+                break;
+            case OpCode::PUSH_POLYNOMIAL: {
+                const Polynomial& polynomial = polynomials_[instruction.operand];
+                *++top = estrin(x, constants + polynomial.offset, polynomial);
+                break;
+            }
+            case OpCode::INTEGER_POWER:
+                *top = integerPower(*top, static_cast<std::int32_t>(instruction.operand),
+                                    multiplyScalars, divideScalars, 1.0);
+                break;
+            case OpCode::SIN:
+                *top = std::sin(*top);
+                break;
+            case OpCode::COS:
+                *top = std::cos(*top);
+                break;
+            case OpCode::TAN:
+                *top = std::tan(*top);
+                break;
+            case OpCode::EXP:
+                *top = std::exp(*top);
+                break;
+            case OpCode::LOG:
+                *top = std::log(*top);
+                break;
+            case OpCode::SQRT:
+                *top = std::sqrt(*top);
+                break;
+            case OpCode::ABS:
+                *top = std::abs(*top);
+                break;
+        }
+    }
+    return *top;
+}
+
+void Bytecode::runBlock(const double* xs, double* ys, const size_t blockSize, double* stack,
+                        double* temporaries) const {
+    static_assert(BLOCK_SIZE % simd::LANES == 0);
+    const size_t lanes = (blockSize + simd::LANES - 1) / simd::LANES * simd::LANES;
+    double* top = stack - BLOCK_SIZE;
+    for (const Instruction& instruction : instructions_) {
+        switch (instruction.opCode) {
+            case OpCode::PUSH_CONSTANT: {
+                top += BLOCK_SIZE;
+                const simd::Vec value = simd::broadcast(constants_[instruction.operand]);
+                for (size_t i = 0; i < lanes; i += simd::LANES) {
+                    simd::store(top + i, value);
+                }
+                break;
+            }
+            case OpCode::PUSH_VARIABLE:
+                top += BLOCK_SIZE;
+                std::copy_n(xs, blockSize, top);
+                std::fill(top + blockSize, top + lanes, 0.0);
+                break;
+            case OpCode::STORE:
+                std::copy_n(top, lanes, temporaries + instruction.operand * BLOCK_SIZE);
+                break;
+            case OpCode::LOAD:
+                top += BLOCK_SIZE;
+                std::copy_n(temporaries + instruction.operand * BLOCK_SIZE, lanes, top);
+                break;
+            case OpCode::ADD:
+                top -= BLOCK_SIZE;
+                combineLanes(top, top + BLOCK_SIZE, lanes, simd::add);
+                break;
+            case OpCode::SUBTRACT:
+                top -= BLOCK_SIZE;
+                combineLanes(top, top + BLOCK_SIZE, lanes, simd::sub);
+                break;
+            case OpCode::MULTIPLY:
+                top -= BLOCK_SIZE;
+                combineLanes(top, top + BLOCK_SIZE, lanes, simd::mul);
+                break;
+            case OpCode::DIVIDE:
+                top -= BLOCK_SIZE;
+                combineLanes(top, top + BLOCK_SIZE, lanes, simd::div);
+                break;
+            case OpCode::POWER:
+                top -= BLOCK_SIZE;
+                for (size_t i = 0; i < blockSize; ++i) {
+                    top[i] = std::pow(top[i], top[BLOCK_SIZE + i]);
+                }
+                break;
+            case OpCode::PUSH_POLYNOMIAL: {
+                top += BLOCK_SIZE;
+                std::copy_n(xs, blockSize, top);
+                std::fill(top + blockSize, top + lanes, 0.0);
+                const Polynomial& polynomial = polynomials_[instruction.operand];
+                const double* coefficients = constants_.data() + polynomial.offset;
+                size_t i = 0;
+                for (; i + 2 * simd::LANES <= lanes; i += 2 * simd::LANES) {
+                    estrin<2>(top + i, coefficients, polynomial);
+                }
+                if (i < lanes) {
+                    estrin<1>(top + i, coefficients, polynomial);
+                }
+                break;
+            }
+            case OpCode::INTEGER_POWER: {
+                const int exponent = static_cast<std::int32_t>(instruction.operand);
+                for (size_t i = 0; i < lanes; i += simd::LANES) {
+                    simd::store(top + i, integerPower(simd::load(top + i), exponent, simd::mul,
+                                                      simd::div, simd::broadcast(1.0)));
+                }
+                break;
+            }
+            case OpCode::SIN:
+                vector_math::sin(top, blockSize, accuracy_);
+                break;
+            case OpCode::COS:
+                vector_math::cos(top, blockSize, accuracy_);
+                break;
+            case OpCode::TAN:
+                vector_math::tan(top, blockSize, accuracy_);
+                break;
+            case OpCode::EXP:
+                vector_math::exp(top, blockSize, accuracy_);
+                break;
+            case OpCode::LOG:
+                vector_math::log(top, blockSize, accuracy_);
+                break;
+            case OpCode::SQRT:
+                vector_math::sqrt(top, lanes);
+                break;
+            case OpCode::ABS:
+                vector_math::abs(top, lanes);
+                break;
+        }
+    }
+    std::copy_n(top, blockSize, ys);
+}
@@ -0,0 +1,160 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "expression.h"
+#include "vector_math.h"
+
+/**
+ * A flat postfix program computing an expression of a single variable on a value stack
+ */
+class Bytecode {
+    public:
+        /**
+         * PUSH_POLYNOMIAL pushes a polynomial of the variable, its operand indexes polynomials().
+         * INTEGER_POWER raises the top of the stack to the power of its operand, a signed
+         * integer, by repeated multiplication.
+         */
+        enum class OpCode : std::uint8_t {
+            PUSH_CONSTANT, PUSH_VARIABLE, PUSH_POLYNOMIAL, STORE, LOAD, ADD, SUBTRACT, MULTIPLY,
+            DIVIDE, POWER, INTEGER_POWER, SIN, COS, TAN, EXP, LOG, SQRT, ABS
+        };
+
+        struct Instruction {
+            OpCode opCode;
+            std::uint32_t operand;
+        };
+
+        /**
+         * offset - index of the constant term in the constant pool, followed by the coefficients
+         * of the increasing powers
+         * evenDegree, oddDegree - the highest even and odd powers with a nonzero coefficient, 0 if
+         * there are none; the even and odd parts of the polynomial are evaluated from them on
+         */
+        struct Polynomial {
+            std::uint32_t offset;
+            std::uint32_t degree;
+            std::uint32_t evenDegree;
+            std::uint32_t oddDegree;
+        };
+
+        static constexpr size_t MAX_POLYNOMIAL_DEGREE = 64;
+        static constexpr int MAX_INTEGER_POWER = 64;
+
+        /**
+         * @brief Compiles an expression, computing every subexpression shared in the graph only
+         * once and reloading it from a temporary slot afterward.
+         * Subexpressions that are polynomials of the variable are expanded into coefficient form
+         * and evaluated as a whole, and other integer powers are reduced to multiplications.
+         * @param expression compiled expression
+         * @param accuracy implementation of functions used by batch evaluation, single arguments
+         * are always computed by the standard library
+         * @return program computing the root of the expression
+         */
+        static Bytecode compile(const Expression& expression,
+                                vector_math::Accuracy accuracy = vector_math::Accuracy::FAST);
+
+        /**
+         * @brief Appends an instruction pushing a constant onto the stack
+         * @param value pushed constant
+         */
+        void pushConstant(double value);
+
+        /**
+         * @brief Appends an instruction pushing the argument of the function onto the stack
+         */
+        void pushVariable();
+
+        /**
+         * @brief Appends an instruction pushing a polynomial of the argument onto the stack
+         * @param coefficients coefficients of the increasing powers of the argument
+         */
+        void pushPolynomial(const std::vector<double>& coefficients);
+
+        /**
+         * @brief Appends an instruction raising the top of the stack to an integer power
+         * @param exponent power, at most MAX_INTEGER_POWER in absolute value
+         */
+        void pushIntegerPower(int exponent);
+
+        /**
+         * @brief Appends an instruction copying the top of the stack into a temporary slot
+         * @param slot index of the temporary slot
+         */
+        void pushStore(std::uint32_t slot);
+
+        /**
+         * @brief Appends an instruction pushing the value of a temporary slot onto the stack
+         * @param slot index of the temporary slot, written by an earlier store
+         */
+        void pushLoad(std::uint32_t slot);
+
+        /**
+         * @brief Appends a binary operation consuming two topmost values of the stack, or a
+         * function replacing the topmost value
+         * @param opCode arithmetic operation or function
+         */
+        void pushOperation(OpCode opCode);
+
+        /**
+         * @brief Runs the program
+         * @param x argument of the function
+         * @return value left on top of the stack
+         */
+        double operator()(double x) const;
+
+        /**
+         * @brief Runs the program for a batch of arguments, executing each instruction over a
+         * block of arguments at once
+         * @param xs arguments
+         * @param ys output array receiving one result per argument
+         * @param count number of arguments
+         */
+        void operator()(const double* xs, double* ys, size_t count) const;
+
+        const std::vector<Instruction>& instructions() const;
+
+        const std::vector<double>& constants() const;
+
+        const std::vector<Polynomial>& polynomials() const;
+
+        size_t stackDepth() const;
+
+        size_t temporaries() const;
+
+        vector_math::Accuracy accuracy() const;
+
+        /**
+         * @return whether the operation is a function of a single value
+         */
+        static bool isFunction(OpCode opCode);
+
+    private:
+        static constexpr size_t INLINE_STACK_SIZE = 64;
+        static constexpr size_t BLOCK_SIZE = 256;
+
+        std::vector<Instruction> instructions_;
+        std::vector<double> constants_;
+        std::vector<Polynomial> polynomials_;
+        size_t depth_ = 0;
+        size_t maxDepth_ = 0;
+        size_t temporaries_ = 0;
+        vector_math::Accuracy accuracy_ = vector_math::Accuracy::FAST;
+
+        void emit(const Expression& expression, Expression::Index index,
+                  const std::vector<unsigned>& uses,
+                  const std::vector<std::vector<double> >& expansions,
+                  std::vector<std::uint32_t>& slots);
+
+        static std::vector<std::vector<double> > expandPolynomials(
+            const Expression& expression, const std::vector<bool>& reachable);
+
+        double run(double x, double* stack, double* temporaries) const;
+
+        void runBlock(const double* xs, double* ys, size_t blockSize, double* stack,
+                      double* temporaries) const;
+};
+
+#endif //BYTECODE_H
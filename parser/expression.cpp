@@ -0,0 +1,499 @@
+#include "expression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+Expression::Index Expression::constant(const double value) {
+    nodes_.push_back({Kind::CONSTANT, static_cast<Index>(constants_.size()), 0});
+    constants_.push_back(value);
+    return static_cast<Index>(nodes_.size() - 1);
+}
+
+Expression::Index Expression::variable() {
+    nodes_.push_back({Kind::VARIABLE, 0, 0});
+    return static_cast<Index>(nodes_.size() - 1);
+}
+
+Expression::Index Expression::operation(const Kind kind, const Index left, const Index right) {
+    if (kind == Kind::CONSTANT || kind == Kind::VARIABLE || isFunction(kind) ||
+        left >= nodes_.size() || right >= nodes_.size()) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    nodes_.push_back({kind, left, right});
+    return static_cast<Index>(nodes_.size() - 1);
+}
+
+Expression::Index Expression::function(const Kind kind, const Index argument) {
+    if (!isFunction(kind) || argument >= nodes_.size()) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    nodes_.push_back({kind, argument, 0});
+    return static_cast<Index>(nodes_.size() - 1);
+}
+
+bool Expression::isFunction(const Kind kind) {
+    return kind >= Kind::SIN;
+}
+
+void Expression::reserve(const size_t nodes) {
+    nodes_.reserve(nodes);
+    constants_.reserve(nodes);
+}
+
+const Expression::Node& Expression::node(const Index index) const {
+    return nodes_[index];
+}
+
+double Expression::value(const Index index) const {
+    return constants_[nodes_[index].left];
+}
+
+bool Expression::isConstant(const Index index) const {
+    return nodes_[index].kind == Kind::CONSTANT;
+}
+
+bool Expression::isConstant(const Index index, const double value) const {
+    return isConstant(index) && this->value(index) == value;
+}
+
+size_t Expression::size() const {
+    return nodes_.size();
+}
+
+Expression::Index Expression::root() const {
+    return root_;
+}
+
+void Expression::setRoot(const Index root) {
+    if (root >= nodes_.size()) {
+        throw std::invalid_argument("Invalid expression");
+    }
+    root_ = root;
+}
+
+std::vector<bool> Expression::reachable() const {
+    std::vector<bool> reachable(nodes_.size());
+    reachable[root_] = true;
+    for (Index i = root_ + 1; i-- > 0;) {
+        const Node& node = nodes_[i];
+        if (reachable[i] && node.kind != Kind::CONSTANT && node.kind != Kind::VARIABLE) {
+            reachable[node.left] = true;
+            reachable[node.right] = reachable[node.right] || !isFunction(node.kind);
+        }
+    }
+    return reachable;
+}
+
+namespace {
+    using Kind = Expression::Kind;
+    using Index = Expression::Index;
+
+    /**
+     * @param value index of the function applied to f
+     * @return derivative of the function of kind applied to f, without the factor f'
+     */
+    Index functionDerivative(ExpressionBuilder& builder, const Kind kind, const Index f,
+                             const Index value) {
+        switch (kind) {
+            case Kind::SIN:
+                return builder.function(Kind::COS, f);
+            case Kind::COS:
+                return builder.operation(Kind::MULTIPLY, builder.constant(-1.0),
+                                         builder.function(Kind::SIN, f));
+            case Kind::TAN: {
+                const Index cosine = builder.function(Kind::COS, f);
+                return builder.operation(Kind::DIVIDE, builder.constant(1.0),
+                                         builder.operation(Kind::MULTIPLY, cosine, cosine));
+            }
+            case Kind::EXP:
+                return value;
+            case Kind::LOG:
+                return builder.operation(Kind::DIVIDE, builder.constant(1.0), f);
+            case Kind::SQRT:
+                return builder.operation(Kind::DIVIDE, builder.constant(0.5), value);
+            case Kind::ABS:
+                return builder.operation(Kind::DIVIDE, f, value);
+            default:
+                throw std::invalid_argument("Invalid expression");
+        }
+    }
+}
+
+/**
+ * Forward-mode pass over the nodes in topological order, building every reachable node f and its
+ * derivative f' side by side.
+ */
+Expression Expression::derivative() const {
+    const std::vector<bool> reachable = this->reachable();
+    ExpressionBuilder builder(4 * nodes_.size());
+    std::vector<Index> values(nodes_.size());
+    std::vector<Index> derivatives(nodes_.size());
+    for (Index i = 0; i <= root_; ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const Node& node = nodes_[i];
+        if (node.kind == Kind::CONSTANT) {
+            values[i] = builder.constant(value(i));
+            derivatives[i] = builder.constant(0.0);
+            continue;
+        }
+        if (node.kind == Kind::VARIABLE) {
+            values[i] = builder.variable();
+            derivatives[i] = builder.constant(1.0);
+            continue;
+        }
+        const Index f = values[node.left];
+        const Index df = derivatives[node.left];
+        if (isFunction(node.kind)) {
+            values[i] = builder.function(node.kind, f);
+            derivatives[i] = builder.operation(Kind::MULTIPLY,
+                                               functionDerivative(builder, node.kind, f,
+                                                                  values[i]), df);
+            continue;
+        }
+        const Index g = values[node.right];
+        const Index dg = derivatives[node.right];
+        values[i] = builder.operation(node.kind, f, g);
+        switch (node.kind) {
+            case Kind::ADD:
+            case Kind::SUBTRACT:
+                derivatives[i] = builder.operation(node.kind, df, dg);
+                break;
+            case Kind::MULTIPLY:
+                derivatives[i] = builder.operation(Kind::ADD,
+                                                   builder.operation(Kind::MULTIPLY, df, g),
+                                                   builder.operation(Kind::MULTIPLY, f, dg));
+                break;
+            case Kind::DIVIDE:
+                derivatives[i] = builder.operation(
+                    Kind::DIVIDE,
+                    builder.operation(Kind::SUBTRACT, builder.operation(Kind::MULTIPLY, df, g),
+                                      builder.operation(Kind::MULTIPLY, f, dg)),
+                    builder.operation(Kind::MULTIPLY, g, g));
+                break;
+            case Kind::POWER:
+                if (isConstant(node.right)) {
+                    // (f^c)' = c * f^(c-1) * f'
+                    const double c = value(node.right);
+                    const Index power = builder.operation(Kind::POWER, f, builder.constant(c - 1));
+                    derivatives[i] = builder.operation(
+                        Kind::MULTIPLY,
+                        builder.operation(Kind::MULTIPLY, builder.constant(c), power), df);
+                } else if (isConstant(node.left)) {
+                    // (c^g)' = c^g * ln(c) * g'
+                    derivatives[i] = builder.operation(
+                        Kind::MULTIPLY,
+                        builder.operation(Kind::MULTIPLY, values[i],
+                                          builder.constant(std::log(value(node.left)))), dg);
+                } else {
+                    // (f^g)' = f^g * (g' * ln(f) + g * f' / f)
+                    const Index logarithm = builder.operation(
+                        Kind::MULTIPLY, dg, builder.function(Kind::LOG, f));
+                    const Index quotient = builder.operation(
+                        Kind::DIVIDE, builder.operation(Kind::MULTIPLY, g, df), f);
+                    derivatives[i] = builder.operation(
+                        Kind::MULTIPLY, values[i],
+                        builder.operation(Kind::ADD, logarithm, quotient));
+                }
+                break;
+            default:
+                throw std::invalid_argument("Invalid expression");
+        }
+    }
+    return builder.build(derivatives[root_]);
+}
+
+Interval Expression::enclose(const Interval& argument) const {
+    std::vector<Interval> ranges(root_ + 1);
+    for (Index i = 0; i <= root_; ++i) {
+        const Node& node = nodes_[i];
+        switch (node.kind) {
+            case Kind::CONSTANT:
+                ranges[i] = Interval::point(value(i));
+                break;
+            case Kind::VARIABLE:
+                ranges[i] = argument;
+                break;
+            case Kind::ADD:
+                ranges[i] = ranges[node.left] + ranges[node.right];
+                break;
+            case Kind::SUBTRACT:
+                ranges[i] = ranges[node.left] - ranges[node.right];
+                break;
+            case Kind::MULTIPLY:
+                ranges[i] = ranges[node.left] * ranges[node.right];
+                break;
+            case Kind::DIVIDE:
+                ranges[i] = ranges[node.left] / ranges[node.right];
+                break;
+            case Kind::POWER:
+                ranges[i] = ranges[node.left].pow(ranges[node.right]);
+                break;
+            case Kind::SIN:
+                ranges[i] = ranges[node.left].sin();
+                break;
+            case Kind::COS:
+                ranges[i] = ranges[node.left].cos();
+                break;
+            case Kind::TAN:
+                ranges[i] = ranges[node.left].tan();
+                break;
+            case Kind::EXP:
+                ranges[i] = ranges[node.left].exp();
+                break;
+            case Kind::LOG:
+                ranges[i] = ranges[node.left].log();
+                break;
+            case Kind::SQRT:
+                ranges[i] = ranges[node.left].sqrt();
+                break;
+            case Kind::ABS:
+                ranges[i] = ranges[node.left].abs();
+                break;
+        }
+    }
+    return ranges[root_];
+}
+
+namespace {
+    std::uint64_t bitsOf(const double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+}
+
+ExpressionBuilder::ExpressionBuilder(const size_t expectedNodes) {
+    expression.reserve(expectedNodes);
+    size_t size = 16;
+    while (size < 2 * expectedNodes) {
+        size *= 2;
+    }
+    table.assign(size, EMPTY_SLOT);
+}
+
+template <typename Append>
+ExpressionBuilder::Index ExpressionBuilder::intern(const Kind kind, const std::uint64_t left,
+                                                   const Index right, Append append) {
+    if (2 * (tableLoad + 1) > table.size()) {
+        resizeTable(2 * table.size());
+    }
+    const size_t mask = table.size() - 1;
+    size_t slot = hash(kind, left, right) & mask;
+    while (table[slot] != EMPTY_SLOT) {
+        if (matches(table[slot], kind, left, right)) {
+            return table[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    const Index index = append();
+    table[slot] = index;
+    ++tableLoad;
+    return index;
+}
+
+ExpressionBuilder::Index ExpressionBuilder::constant(const double value) {
+    return intern(Kind::CONSTANT, bitsOf(value), 0, [this, value] {
+        return expression.constant(value);
+    });
+}
+
+ExpressionBuilder::Index ExpressionBuilder::variable() {
+    if (!hasVariable) {
+        variableIndex = expression.variable();
+        hasVariable = true;
+    }
+    return variableIndex;
+}
+
+ExpressionBuilder::Index ExpressionBuilder::function(const Kind kind, const Index argument) {
+    if (expression.isConstant(argument)) {
+        return constant(calc(expression.value(argument), kind, 0));
+    }
+    if (kind == Kind::ABS) {
+        const Kind argumentKind = expression.node(argument).kind;
+        if (argumentKind == Kind::ABS || argumentKind == Kind::SQRT ||
+            argumentKind == Kind::EXP) {
+            return argument;
+        }
+    }
+    return intern(kind, argument, 0, [this, kind, argument] {
+        return expression.function(kind, argument);
+    });
+}
+
+ExpressionBuilder::Index ExpressionBuilder::operation(const Kind kind, Index left, Index right) {
+    if (expression.isConstant(left) && expression.isConstant(right)) {
+        return constant(calc(expression.value(left), kind, expression.value(right)));
+    }
+    const Index simplified = simplify(kind, left, right);
+    if (simplified != expression.size()) {
+        return simplified;
+    }
+    if ((kind == Kind::ADD || kind == Kind::MULTIPLY) && right < left) {
+        std::swap(left, right);
+    }
+    return intern(kind, left, right, [this, kind, left, right] {
+        return expression.operation(kind, left, right);
+    });
+}
+
+Expression ExpressionBuilder::build(const Index root) {
+    expression.setRoot(root);
+    const std::vector<bool> reachable = expression.reachable();
+    Expression result;
+    if (std::find(reachable.begin(), reachable.end(), false) == reachable.end()) {
+        result = std::move(expression);
+    } else {
+        std::vector<Index> remapped(expression.size());
+        result.reserve(expression.size());
+        for (Index i = 0; i <= root; ++i) {
+            if (!reachable[i]) {
+                continue;
+            }
+            const Expression::Node& node = expression.node(i);
+            switch (node.kind) {
+                case Kind::CONSTANT:
+                    remapped[i] = result.constant(expression.value(i));
+                    break;
+                case Kind::VARIABLE:
+                    remapped[i] = result.variable();
+                    break;
+                default:
+                    remapped[i] = Expression::isFunction(node.kind)
+                                      ? result.function(node.kind, remapped[node.left])
+                                      : result.operation(node.kind, remapped[node.left],
+                                                         remapped[node.right]);
+            }
+        }
+        result.setRoot(remapped[root]);
+    }
+    expression = Expression();
+    std::fill(table.begin(), table.end(), EMPTY_SLOT);
+    tableLoad = 0;
+    hasVariable = false;
+    return result;
+}
+
+double ExpressionBuilder::calc(const double a, const Kind kind, const double b) {
+    switch (kind) {
+        case Kind::ADD:
+            return a + b;
+        case Kind::SUBTRACT:
+            return a - b;
+        case Kind::MULTIPLY:
+            return a * b;
+        case Kind::DIVIDE:
+            return a / b;
+        case Kind::POWER:
+            return std::pow(a, b);
+        case Kind::SIN:
+            return std::sin(a);
+        case Kind::COS:
+            return std::cos(a);
+        case Kind::TAN:
+            return std::tan(a);
+        case Kind::EXP:
+            return std::exp(a);
+        case Kind::LOG:
+            return std::log(a);
+        case Kind::SQRT:
+            return std::sqrt(a);
+        case Kind::ABS:
+            return std::abs(a);
+        default:
+            throw std::invalid_argument("Invalid expression");
+    }
+}
+
+/**
+ * @return index of an equivalent, already existing node, or the size of the expression if
+ * no identity applies
+ */
+ExpressionBuilder::Index ExpressionBuilder::simplify(const Kind kind, const Index left,
+                                                     const Index right) {
+    switch (kind) {
+        case Kind::ADD:
+            if (expression.isConstant(left, 0.0)) {
+                return right;
+            }
+            if (expression.isConstant(right, 0.0)) {
+                return left;
+            }
+            break;
+        case Kind::SUBTRACT:
+            if (expression.isConstant(right, 0.0)) {
+                return left;
+            }
+            break;
+        case Kind::MULTIPLY:
+            if (expression.isConstant(left, 1.0)) {
+                return right;
+            }
+            if (expression.isConstant(right, 1.0)) {
+                return left;
+            }
+            break;
+        case Kind::DIVIDE:
+            if (expression.isConstant(right, 1.0)) {
+                return left;
+            }
+            break;
+        case Kind::POWER:
+            if (expression.isConstant(right, 1.0)) {
+                return left;
+            }
+            if (expression.isConstant(right, 0.0)) {
+                return constant(1.0);
+            }
+            if (expression.isConstant(right, 2.0)) {
+                return operation(Kind::MULTIPLY, left, left);
+            }
+            break;
+        default:
+            break;
+    }
+    return static_cast<Index>(expression.size());
+}
+
+bool ExpressionBuilder::matches(const Index index, const Kind kind, const std::uint64_t left,
+                                const Index right) const {
+    const Expression::Node& node = expression.node(index);
+    return node.kind == kind && key(index) == left &&
+           (kind == Kind::CONSTANT || node.right == right);
+}
+
+std::uint64_t ExpressionBuilder::key(const Index index) const {
+    return expression.isConstant(index) ? bitsOf(expression.value(index))
+                                        : expression.node(index).left;
+}
+
+void ExpressionBuilder::resizeTable(const size_t size) {
+    std::vector<Index> entries;
+    entries.reserve(tableLoad);
+    std::copy_if(table.begin(), table.end(), std::back_inserter(entries), [](const Index index) {
+        return index != EMPTY_SLOT;
+    });
+    table.assign(size, EMPTY_SLOT);
+    const size_t mask = size - 1;
+    for (const Index index : entries) {
+        const Expression::Node& node = expression.node(index);
+        size_t slot = hash(node.kind, key(index), node.right) & mask;
+        while (table[slot] != EMPTY_SLOT) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = index;
+    }
+}
+
+size_t ExpressionBuilder::hash(const Kind kind, const std::uint64_t left, const Index right) {
+    std::uint64_t h = left * 0x9E3779B97F4A7C15ULL;
+    h ^= (static_cast<std::uint64_t>(right) << 8 | static_cast<std::uint64_t>(kind)) +
+        0xBF58476D1CE4E5B9ULL + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h ^ h >> 31);
+}
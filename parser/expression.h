@@ -0,0 +1,151 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "interval.h"
+
+/**
+ * An expression of a single variable stored as a graph of index-linked nodes.
+ * Nodes are kept in topological order: operands always precede the nodes using them.
+ */
+class Expression {
+    public:
+        using Index = std::uint32_t;
+
+        enum class Kind : std::uint8_t {
+            CONSTANT, VARIABLE, ADD, SUBTRACT, MULTIPLY, DIVIDE, POWER,
+            SIN, COS, TAN, EXP, LOG, SQRT, ABS
+        };
+
+        /**
+         * left - index of the left operand, the argument of a function, or of the value in the
+         * constant pool for CONSTANT
+         * right - index of the right operand, unused by functions
+         */
+        struct Node {
+            Kind kind;
+            Index left;
+            Index right;
+        };
+
+        Index constant(double value);
+
+        Index variable();
+
+        Index operation(Kind kind, Index left, Index right);
+
+        Index function(Kind kind, Index argument);
+
+        /**
+         * @return whether nodes of the kind are unary functions
+         */
+        static bool isFunction(Kind kind);
+
+        void reserve(size_t nodes);
+
+        const Node& node(Index index) const;
+
+        double value(Index index) const;
+
+        bool isConstant(Index index) const;
+
+        bool isConstant(Index index, double value) const;
+
+        size_t size() const;
+
+        Index root() const;
+
+        void setRoot(Index root);
+
+        /**
+         * @return reachability of every node from the root
+         */
+        std::vector<bool> reachable() const;
+
+        /**
+         * @brief Differentiates the expression with respect to its variable
+         * @return simplified derivative
+         */
+        Expression derivative() const;
+
+        /**
+         * @brief Evaluates the expression in interval arithmetic
+         * @param argument range of the variable
+         * @return enclosure of the values of the expression over the range
+         */
+        Interval enclose(const Interval& argument) const;
+
+    private:
+        std::vector<Node> nodes_;
+        std::vector<double> constants_;
+        Index root_ = 0;
+};
+
+/**
+ * Builds an Expression bottom-up, simplifying it on the way:
+ * folds constant operations, applies identities that hold for every argument
+ * (x*1, x+0, x-0, x/1, x^1, x^0, |f| = f for non-negative f) plus x^2 = x*x, and merges
+ * structurally identical subexpressions, so the result is a DAG in which every distinct
+ * subexpression appears once.
+ */
+class ExpressionBuilder {
+    public:
+        using Index = Expression::Index;
+        using Kind = Expression::Kind;
+
+        /**
+         * @brief Constructs a builder
+         * @param expectedNodes number of nodes the built expression is expected to have at most
+         */
+        explicit ExpressionBuilder(size_t expectedNodes = 0);
+
+        Index constant(double value);
+
+        Index variable();
+
+        Index operation(Kind kind, Index left, Index right);
+
+        Index function(Kind kind, Index argument);
+
+        /**
+         * @brief Finishes building, dropping nodes the root does not depend on
+         * @param root index of the node computing the whole expression
+         * @return built expression, the builder is left empty
+         */
+        Expression build(Index root);
+
+        /**
+         * @brief Computes an operation on constants, or a function of a, ignoring b
+         */
+        static double calc(double a, Kind kind, double b);
+
+    private:
+        static constexpr Index EMPTY_SLOT = UINT32_MAX;
+
+        Expression expression;
+        /**
+         * Open addressing hash set of node indices, used to find existing nodes with given
+         * contents. CONSTANT nodes are keyed by the bits of their value.
+         */
+        std::vector<Index> table;
+        size_t tableLoad = 0;
+        bool hasVariable = false;
+        Index variableIndex = 0;
+
+        Index simplify(Kind kind, Index left, Index right);
+
+        template <typename Append>
+        Index intern(Kind kind, std::uint64_t left, Index right, Append append);
+
+        bool matches(Index index, Kind kind, std::uint64_t left, Index right) const;
+
+        std::uint64_t key(Index index) const;
+
+        void resizeTable(size_t size);
+
+        static size_t hash(Kind kind, std::uint64_t left, Index right);
+};
+
+#endif //EXPRESSION_H
@@ -0,0 +1,135 @@
+#include "function_cache.h"
+
+#include <utility>
+
+#include "function_parser.h"
+
+FunctionCache::FunctionCache(const size_t capacity, const bool jitEnabled,
+                             const vector_math::Accuracy accuracy): capacity_(capacity),
+                                                                    jitEnabled(jitEnabled),
+                                                                    accuracy(accuracy) { }
+
+FunctionCache::FunctionPtr FunctionCache::get(const std::string& polishNotation) {
+    std::string key = FunctionParser::normalize(polishNotation);
+    {
+        std::lock_guard lock(mutex);
+        if (FunctionPtr function = find(key)) {
+            ++hits_;
+            return function;
+        }
+        ++misses_;
+    }
+    FunctionParser parser(jitEnabled, accuracy);
+    FunctionPtr function(parser.parsePolishNotation(key));
+    std::lock_guard lock(mutex);
+    return insert(std::move(key), std::move(function));
+}
+
+std::vector<FunctionCache::FunctionPtr> FunctionCache::getAll(
+    const std::vector<std::string>& polishNotations, unsigned threadsCount) {
+    std::vector<FunctionPtr> functions(polishNotations.size());
+    std::vector<std::string> missing;
+    std::unordered_map<std::string, std::vector<size_t> > requesters;
+    {
+        std::lock_guard lock(mutex);
+        for (size_t i = 0; i < polishNotations.size(); ++i) {
+            std::string key = FunctionParser::normalize(polishNotations[i]);
+            if ((functions[i] = find(key))) {
+                ++hits_;
+                continue;
+            }
+            auto& indices = requesters[key];
+            if (indices.empty()) {
+                ++misses_;
+                missing.push_back(std::move(key));
+            } else {
+                ++hits_;
+            }
+            indices.push_back(i);
+        }
+    }
+
+    std::vector<FunctionPtr> parsed(missing.size());
+    if (missing.size() == 1) {
+        FunctionParser parser(jitEnabled, accuracy);
+        parsed[0] = FunctionPtr(parser.parsePolishNotation(missing[0]));
+    } else if (!missing.empty()) {
+        parsingPool(threadsCount)->parallelFor(missing.size(), [&](const size_t i) {
+            FunctionParser parser(jitEnabled, accuracy);
+            parsed[i] = FunctionPtr(parser.parsePolishNotation(missing[i]));
+        });
+    }
+
+    std::lock_guard lock(mutex);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        const std::vector<size_t>& indices = requesters[missing[i]];
+        FunctionPtr function = insert(std::move(missing[i]), std::move(parsed[i]));
+        for (const size_t index : indices) {
+            functions[index] = function;
+        }
+    }
+    return functions;
+}
+
+size_t FunctionCache::hits() const {
+    std::lock_guard lock(mutex);
+    return hits_;
+}
+
+size_t FunctionCache::misses() const {
+    std::lock_guard lock(mutex);
+    return misses_;
+}
+
+size_t FunctionCache::size() const {
+    std::lock_guard lock(mutex);
+    return entries.size();
+}
+
+size_t FunctionCache::capacity() const {
+    return capacity_;
+}
+
+void FunctionCache::clear() {
+    std::lock_guard lock(mutex);
+    index.clear();
+    entries.clear();
+}
+
+std::shared_ptr<ThreadPool> FunctionCache::parsingPool(const unsigned threadsCount) {
+    std::lock_guard lock(mutex);
+    if (!pool || poolThreadsCount != threadsCount) {
+        pool = std::make_shared<ThreadPool>(threadsCount);
+        poolThreadsCount = threadsCount;
+    }
+    return pool;
+}
+
+FunctionCache::FunctionPtr FunctionCache::find(const std::string& key) {
+    const auto found = index.find(key);
+    if (found == index.end()) {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->function;
+}
+
+/**
+ * If another thread cached the same expression in the meantime, its function is kept and
+ * returned instead
+ */
+FunctionCache::FunctionPtr FunctionCache::insert(std::string key, FunctionPtr function) {
+    if (const FunctionPtr existing = find(key)) {
+        return existing;
+    }
+    if (capacity_ == 0) {
+        return function;
+    }
+    if (entries.size() == capacity_) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    entries.push_front({std::move(key), std::move(function)});
+    index.emplace(entries.front().key, entries.begin());
+    return entries.front().function;
+}
@@ -0,0 +1,105 @@
+#ifndef FUNCTION_CACHE_H
+#define FUNCTION_CACHE_H
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "parsed_function.h"
+#include "vector_math.h"
+#include "util/thread_pool.h"
+
+/**
+ * A thread-safe cache of functions parsed from Polish notation, keyed by the normalized
+ * expression. Cached functions are immutable and shared; evicting an entry (least recently
+ * used first) only drops the reference held by the cache.
+ */
+class FunctionCache {
+    public:
+        using FunctionPtr = std::shared_ptr<const ParsedFunction>;
+
+        static constexpr size_t DEFAULT_CAPACITY = 256;
+
+        /**
+         * @brief Constructs an empty cache
+         * @param capacity maximal number of cached functions
+         * @param jitEnabled whether cached functions are compiled to native code
+         * @param accuracy implementation of functions used by cached functions
+         */
+        explicit FunctionCache(size_t capacity = DEFAULT_CAPACITY, bool jitEnabled = false,
+                               vector_math::Accuracy accuracy = vector_math::Accuracy::FAST);
+
+        FunctionCache(const FunctionCache&) = delete;
+
+        FunctionCache& operator=(const FunctionCache&) = delete;
+
+        /**
+         * @brief Returns the cached function for an expression, parsing it on a miss
+         * @param polishNotation expression in Polish notation
+         * @return shared parsed function
+         */
+        FunctionPtr get(const std::string& polishNotation);
+
+        /**
+         * @brief Returns functions for a batch of expressions. Identical expressions are parsed
+         * once, and the expressions missing from the cache are parsed in parallel, on a pool of
+         * threads kept by the cache for the following batches.
+         * @param polishNotations expressions in Polish notation
+         * @param threadsCount number of parsing threads, 0 for one per hardware thread; the pool
+         * is restarted only when this changes
+         * @return shared parsed functions, in the order of the expressions
+         */
+        std::vector<FunctionPtr> getAll(const std::vector<std::string>& polishNotations,
+                                        unsigned threadsCount = 0);
+
+        /**
+         * @return number of requested expressions that did not need parsing
+         */
+        size_t hits() const;
+
+        /**
+         * @return number of requested expressions that had to be parsed
+         */
+        size_t misses() const;
+
+        size_t size() const;
+
+        size_t capacity() const;
+
+        void clear();
+
+    private:
+        struct Entry {
+            std::string key;
+            FunctionPtr function;
+        };
+
+        mutable std::mutex mutex;
+        /**
+         * Most recently used entries first
+         */
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        size_t capacity_;
+        bool jitEnabled;
+        vector_math::Accuracy accuracy;
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+        /**
+         * Parses the batches, started with the first one that misses the cache; held by the
+         * batches running, so that it outlives them if restarted with another size
+         */
+        std::shared_ptr<ThreadPool> pool;
+        unsigned poolThreadsCount = 0;
+
+        std::shared_ptr<ThreadPool> parsingPool(unsigned threadsCount);
+
+        FunctionPtr find(const std::string& key);
+
+        FunctionPtr insert(std::string key, FunctionPtr function);
+};
+
+#endif //FUNCTION_CACHE_H
@@ -1,12 +1,32 @@
 #include "function_parser.h"
 
 #include <algorithm>
+#include <charconv>
 #include <cmath>
-#include <regex>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+namespace {
+    struct NamedFunction {
+        std::string_view name;
+        Expression::Kind kind;
+    };
+
+    constexpr NamedFunction FUNCTIONS[] = {
+        {"sin", Expression::Kind::SIN}, {"cos", Expression::Kind::COS},
+        {"tan", Expression::Kind::TAN}, {"exp", Expression::Kind::EXP},
+        {"log", Expression::Kind::LOG}, {"sqrt", Expression::Kind::SQRT},
+        {"abs", Expression::Kind::ABS}
+    };
+}
+
+FunctionParser::FunctionParser(const bool jitEnabled,
+                               const vector_math::Accuracy accuracy): jitEnabled(jitEnabled),
+                                                                      accuracy(accuracy) { }
+
 ParsedFunction* FunctionParser::parsePolishNotation(const std::string& str) {
-    std::vector<Token> tokens = tokenize(str);
+    const std::vector<Token> tokens = tokenize(str);
     const Token* var = nullptr;
     for (const auto& token : tokens) {
         if (token.type == Token::Type::VARIABLE) {
@@ -18,36 +38,53 @@ ParsedFunction* FunctionParser::parsePolishNotation(const std::string& str) {
         }
     }
 
+    Expression parsed;
+    parsed.reserve(tokens.size());
+    auto begin = tokens.cbegin();
+    parsed.setRoot(parseTree(begin, tokens.cend(), parsed));
+    Expression expression = optimize(parsed);
+    lastStatistics = {parsed.size(), expression.size()};
     if (var == nullptr) {
-        return new ConstFunction(tokens);
+        if (!expression.isConstant(expression.root())) {
+            throw std::invalid_argument("Invalid expression");
+        }
+        return new ConstFunction(expression.value(expression.root()));
     }
-    auto begin = tokens.cbegin();
-    auto end = tokens.cend();
-    return new PolishNotationFunction(parseTree(begin, end));
+    return new PolishNotationFunction(std::move(expression), jitEnabled, accuracy);
 }
 
-std::vector<FunctionParser::Token> FunctionParser::tokenize(const std::string& str) {
-    std::vector<Token> tokens;
-    std::string tokenBuffer;
-    for (const char& c : str) {
-        if (std::isspace(c)) {
-            if (!tokenBuffer.empty()) {
-                pushToken(tokens, tokenBuffer);
-                tokenBuffer.clear();
-            }
-        } else if (std::isdigit(c) || c == '.' || std::isalpha(c)) {
-            tokenBuffer += c;
-        } else if (isOperator(c)) {
-            if (!tokenBuffer.empty()) {
-                pushToken(tokens, tokenBuffer);
-                tokenBuffer.clear();
-            }
-            tokens.emplace_back(std::string(1, c), Token::OPERATOR);
+std::string FunctionParser::normalize(const std::string_view str) {
+    std::string normalized;
+    normalized.reserve(str.size());
+    for (const Token& token : tokenize(str)) {
+        if (!normalized.empty()) {
+            normalized += ' ';
         }
+        normalized += token.value;
     }
-    if (!tokenBuffer.empty()) {
-        pushToken(tokens, tokenBuffer);
+    return normalized;
+}
+
+const FunctionParser::Statistics& FunctionParser::statistics() const {
+    return lastStatistics;
+}
+
+std::vector<FunctionParser::Token> FunctionParser::tokenize(const std::string_view str) {
+    std::vector<Token> tokens;
+    tokens.reserve(str.size() / 2 + 1);
+    size_t tokenStart = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        const char c = str[i];
+        if (isDigit(c) || c == '.' || isLetter(c)) {
+            continue;
+        }
+        pushToken(tokens, str.substr(tokenStart, i - tokenStart));
+        if (isOperator(c)) {
+            tokens.emplace_back(str.substr(i, 1), Token::OPERATOR);
+        }
+        tokenStart = i + 1;
     }
+    pushToken(tokens, str.substr(tokenStart));
     return tokens;
 }
 
@@ -55,157 +92,226 @@ double FunctionParser::PolishNotationFunction::operator()(const double x) const
     if (!std::isfinite(x)) {
         throw std::invalid_argument("Argument is not finite");
     }
-    const BinaryTree* root = this->tree;
-    return eval(root, x);
+    if (native) {
+        double y;
+        (*native)(&x, &y, 1);
+        return y;
+    }
+    return program(x);
+}
+
+void FunctionParser::PolishNotationFunction::evaluate(const double* xs, double* ys,
+                                                      const std::size_t count) const {
+    if (!std::all_of(xs, xs + count, [](const double x) { return std::isfinite(x); })) {
+        throw std::invalid_argument("Argument is not finite");
+    }
+    if (native) {
+        (*native)(xs, ys, count);
+    } else {
+        program(xs, ys, count);
+    }
 }
 
-FunctionParser::PolishNotationFunction::PolishNotationFunction(BinaryTree* root): tree(root) { }
+FunctionParser::PolishNotationFunction::PolishNotationFunction(
+    Expression expression, const bool jitEnabled, const vector_math::Accuracy accuracy):
+    jitEnabled(jitEnabled), accuracy(accuracy), expression(std::move(expression)),
+    program(Bytecode::compile(this->expression, accuracy)),
+    native(jitEnabled ? JitCode::compile(program) : nullptr) { }
 
-FunctionParser::PolishNotationFunction::~PolishNotationFunction() {
-    walkDelete(tree);
+FunctionParser::PolishNotationFunction::~PolishNotationFunction() = default;
+
+ParsedFunction* FunctionParser::PolishNotationFunction::derivative() const {
+    Expression derivative = expression.derivative();
+    if (derivative.isConstant(derivative.root())) {
+        return new ConstFunction(derivative.value(derivative.root()));
+    }
+    return new PolishNotationFunction(std::move(derivative), jitEnabled, accuracy);
+}
+
+std::optional<Interval> FunctionParser::PolishNotationFunction::enclose(const double xMin,
+                                                                       const double xMax) const {
+    return expression.enclose({xMin, xMax, true});
 }
 
 double FunctionParser::ConstFunction::operator()(double x) const {
     return value;
 }
 
-FunctionParser::ConstFunction::ConstFunction(const std::vector<Token>& tokens) {
-    auto begin = tokens.cbegin();
-    auto end = tokens.cend();
-    this->value = eval(begin, end);
+void FunctionParser::ConstFunction::evaluate(const double*, double* ys,
+                                             const std::size_t count) const {
+    std::fill_n(ys, count, value);
 }
 
-FunctionParser::ConstFunction::~ConstFunction() = default;
-
-double FunctionParser::PolishNotationFunction::eval(const BinaryTree* node, const double x) {
-    if (node == nullptr) {
-        throw std::invalid_argument("Invalid expression");
-    }
-    const auto& token = node->token;
-    if (token.type == Token::Type::VARIABLE) {
-        return x;
-    }
-    if (token.type == Token::Type::NUMERIC) {
-        return node->value;
-    }
-    if (token.type != Token::Type::OPERATOR || node->left == nullptr || node->right == nullptr) {
-        throw std::invalid_argument("Invalid expression");
-    }
-    return calc(eval(node->left, x), token.value, eval(node->right, x));
+ParsedFunction* FunctionParser::ConstFunction::derivative() const {
+    return new ConstFunction(0.0);
 }
 
-void FunctionParser::PolishNotationFunction::walkDelete(const BinaryTree* node) {
-    if (node->right != nullptr) {
-        walkDelete(node->right);
-    }
-    if (node->left != nullptr) {
-        walkDelete(node->left);
-    }
-    delete node;
+std::optional<Interval> FunctionParser::ConstFunction::enclose(double, double) const {
+    return Interval::point(value);
 }
 
-double FunctionParser::ConstFunction::eval(std::vector<Token>::const_iterator& begin,
-                                           std::vector<Token>::const_iterator& end) {
-    if (begin == end) {
-        throw std::invalid_argument("Invalid expression");
-    }
-    if (begin->type == Token::Type::VARIABLE) {
-        throw std::invalid_argument("Variable in a constant function");
-    }
-    if (begin->type == Token::Type::NUMERIC) {
-        const double d = std::stod(begin->value);
-        ++begin;
-        return d;
-    }
-    if (begin->type != Token::Type::OPERATOR) {
-        throw std::invalid_argument("Invalid token: " + begin->value);
-    }
-    const auto& op = begin->value;
-    ++begin;
-    const auto a = eval(begin, end);
-    const auto b = eval(begin, end);
-    return calc(a, op, b);
-}
+FunctionParser::ConstFunction::ConstFunction(const double value): value(value) { }
 
-FunctionParser::PolishNotationFunction::BinaryTree* FunctionParser::parseTree(
-    std::vector<Token>::const_iterator& begin, std::vector<Token>::const_iterator& end) {
+FunctionParser::ConstFunction::~ConstFunction() = default;
+
+Expression::Index FunctionParser::parseTree(std::vector<Token>::const_iterator& begin,
+                                            const std::vector<Token>::const_iterator end,
+                                            Expression& expression) {
     if (begin == end) {
         throw std::invalid_argument("Invalid expression");
     }
-    const auto& token = *begin;
-    auto* root = new PolishNotationFunction::BinaryTree(token);
+    const Token& token = *begin;
     ++begin;
-    if (token.type == Token::Type::NUMERIC) {
-        root->value = std::stod(token.value);
-    } else if (token.type == Token::Type::OPERATOR) {
-        root->left = parseTree(begin, end);
-        root->right = parseTree(begin, end);
+    switch (token.type) {
+        case Token::Type::NUMERIC:
+            return expression.constant(parseNumber(token.value));
+        case Token::Type::VARIABLE:
+            return expression.variable();
+        case Token::Type::OPERATOR: {
+            const Expression::Index left = parseTree(begin, end, expression);
+            const Expression::Index right = parseTree(begin, end, expression);
+            return expression.operation(operationKind(token.value[0]), left, right);
+        }
+        case Token::Type::FUNCTION: {
+            const Expression::Index argument = parseTree(begin, end, expression);
+            return expression.function(functionKind(token.value), argument);
+        }
+        default:
+            throw std::invalid_argument("Invalid token: " + std::string(token.value));
     }
-    return root;
 }
 
-FunctionParser::PolishNotationFunction::BinaryTree::BinaryTree(const Token& token): token(token),
-    left(nullptr), right(nullptr) {
-    if (token.type == Token::Type::NUMERIC) {
-        value = std::stod(token.value);
-    } else {
-        value = NAN;
+/**
+ * Rebuilds a parsed expression through ExpressionBuilder. Nodes of a parsed expression are in
+ * topological order, so a single forward pass remapping operands is enough.
+ */
+Expression FunctionParser::optimize(const Expression& parsed) {
+    ExpressionBuilder builder(parsed.size());
+    std::vector<Expression::Index> remapped(parsed.size());
+    for (Expression::Index i = 0; i < parsed.size(); ++i) {
+        const Expression::Node& node = parsed.node(i);
+        switch (node.kind) {
+            case Expression::Kind::CONSTANT:
+                remapped[i] = builder.constant(parsed.value(i));
+                break;
+            case Expression::Kind::VARIABLE:
+                remapped[i] = builder.variable();
+                break;
+            default:
+                remapped[i] = Expression::isFunction(node.kind)
+                                  ? builder.function(node.kind, remapped[node.left])
+                                  : builder.operation(node.kind, remapped[node.left],
+                                                      remapped[node.right]);
+        }
     }
+    return builder.build(remapped[parsed.root()]);
 }
 
-FunctionParser::Token::Token(const std::string& value, const Type type) : value(value), type(type) {
-}
+FunctionParser::Token::Token(const std::string_view value, const Type type) : value(value),
+    type(type) { }
 
-FunctionParser::Token::Type FunctionParser::findType(const std::string& token) {
+FunctionParser::Token::Type FunctionParser::findType(const std::string_view token) {
     if (token.size() == 1 && isOperator(token[0])) {
         return Token::Type::OPERATOR;
     }
     if (isNumber(token)) {
         return Token::Type::NUMERIC;
     }
+    if (isFunction(token)) {
+        return Token::Type::FUNCTION;
+    }
     if (isVariable(token)) {
         return Token::Type::VARIABLE;
     }
     return Token::Type::INVALID;
 }
 
-void FunctionParser::pushToken(std::vector<Token>& tokens, const std::string& tokenBuffer) {
-    const Token::Type type = findType(tokenBuffer);
+void FunctionParser::pushToken(std::vector<Token>& tokens, const std::string_view token) {
+    if (token.empty()) {
+        return;
+    }
+    const Token::Type type = findType(token);
     if (type != Token::INVALID) {
-        tokens.emplace_back(tokenBuffer, type);
+        tokens.emplace_back(token, type);
     }
 }
 
-bool FunctionParser::isNumber(const std::string& token) {
-    const static std::regex numRegex(R"(\d+(\.\d*)?)");
-    return std::regex_match(token, numRegex);
+bool FunctionParser::isDigit(const char c) {
+    return '0' <= c && c <= '9';
+}
+
+bool FunctionParser::isLetter(const char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+/**
+ * Matches digits optionally followed by a dot and more digits
+ */
+bool FunctionParser::isNumber(const std::string_view token) {
+    size_t i = 0;
+    while (i < token.size() && isDigit(token[i])) {
+        ++i;
+    }
+    if (i == 0) {
+        return false;
+    }
+    if (i < token.size() && token[i] == '.') {
+        ++i;
+        while (i < token.size() && isDigit(token[i])) {
+            ++i;
+        }
+    }
+    return i == token.size();
 }
 
-bool FunctionParser::isVariable(const std::string& token) {
-    return std::isalpha(token[0]) && std::all_of(token.begin() + 1, token.end(), [](const char& c) {
-        return std::isalpha(c) || std::isdigit(c);
+bool FunctionParser::isVariable(const std::string_view token) {
+    return isLetter(token[0]) && std::all_of(token.begin() + 1, token.end(), [](const char c) {
+        return isLetter(c) || isDigit(c);
     });
 }
 
-bool FunctionParser::isOperator(const char& c) {
-    return c == '+' || c == '-' || c == '*' || c == '/' || c == '^';
+bool FunctionParser::isFunction(const std::string_view token) {
+    return std::any_of(std::begin(FUNCTIONS), std::end(FUNCTIONS),
+                       [token](const NamedFunction& function) {
+                           return function.name == token;
+                       });
 }
 
-double FunctionParser::calc(const double a, const std::string& op, const double b) {
-    if (op == "+") {
-        return a + b;
-    }
-    if (op == "-") {
-        return a - b;
-    }
-    if (op == "*") {
-        return a * b;
+double FunctionParser::parseNumber(const std::string_view token) {
+    double value = 0;
+    const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc() || end != token.data() + token.size()) {
+        throw std::invalid_argument("Invalid token: " + std::string(token));
     }
-    if (op == "/") {
-        return a / b;
+    return value;
+}
+
+bool FunctionParser::isOperator(const char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '^';
+}
+
+Expression::Kind FunctionParser::operationKind(const char op) {
+    switch (op) {
+        case '+':
+            return Expression::Kind::ADD;
+        case '-':
+            return Expression::Kind::SUBTRACT;
+        case '*':
+            return Expression::Kind::MULTIPLY;
+        case '/':
+            return Expression::Kind::DIVIDE;
+        case '^':
+            return Expression::Kind::POWER;
+        default:
+            throw std::invalid_argument("Invalid token: " + std::string(1, op));
     }
-    if (op == "^") {
-        return std::pow(a, b);
+}
+
+Expression::Kind FunctionParser::functionKind(const std::string_view name) {
+    for (const NamedFunction& function : FUNCTIONS) {
+        if (function.name == name) {
+            return function.kind;
+        }
     }
-    throw std::invalid_argument("Invalid token: " + op);
+    throw std::invalid_argument("Invalid token: " + std::string(name));
 }
@@ -1,80 +1,139 @@
 #ifndef FUNCTION_PARSER_H
 #define FUNCTION_PARSER_H
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+
+#include "bytecode.h"
+#include "expression.h"
+#include "jit_compiler.h"
 #include "parsed_function.h"
 
 class FunctionParser {
     public:
+        /**
+         * parsedNodes - number of nodes in the expression tree as written
+         * optimizedNodes - number of distinct nodes left after simplification
+         */
+        struct Statistics {
+            size_t parsedNodes = 0;
+            size_t optimizedNodes = 0;
+        };
+
+        /**
+         * @brief Constructs a parser
+         * @param jitEnabled whether parsed functions should be compiled to native code when the
+         * machine supports it, instead of being interpreted
+         * @param accuracy implementation of sin, cos, tan, exp and log used by parsed functions
+         * evaluated in batches
+         */
+        explicit FunctionParser(bool jitEnabled = false,
+                                vector_math::Accuracy accuracy = vector_math::Accuracy::FAST);
+
         ParsedFunction* parsePolishNotation(const std::string& str);
 
+        /**
+         * @brief Brings an expression to a canonical textual form: its valid tokens separated by
+         * single spaces. Expressions with equal normal forms parse to the same function.
+         * @param str expression in Polish notation
+         * @return normalized expression
+         */
+        static std::string normalize(std::string_view str);
+
+        /**
+         * @return statistics of the optimization of the most recently parsed function
+         */
+        const Statistics& statistics() const;
+
     private:
+        bool jitEnabled;
+        vector_math::Accuracy accuracy;
+        Statistics lastStatistics;
+
+        /**
+         * value - view into the parsed string
+         */
         struct Token {
             enum Type {
-                NUMERIC, VARIABLE, OPERATOR, INVALID
+                NUMERIC, VARIABLE, OPERATOR, FUNCTION, INVALID
             };
 
-            Token(const std::string& value, Type type);
+            Token(std::string_view value, Type type);
 
-            const std::string value;
-            const Type type;
+            std::string_view value;
+            Type type;
         };
 
-        static std::vector<Token> tokenize(const std::string& str);
+        static std::vector<Token> tokenize(std::string_view str);
 
-        static Token::Type findType(const std::string& token);
+        static Token::Type findType(std::string_view token);
 
-        static void pushToken(std::vector<Token>& tokens, const std::string& tokenBuffer);
+        static void pushToken(std::vector<Token>& tokens, std::string_view token);
 
-        static bool isOperator(const char& c);
+        static bool isOperator(char c);
 
-        static bool isNumber(const std::string& token);
+        static bool isDigit(char c);
 
-        static bool isVariable(const std::string& token);
+        static bool isLetter(char c);
 
-        static double calc(double a, const std::string& op, double b);
+        static bool isNumber(std::string_view token);
 
-        class PolishNotationFunction final : public ParsedFunction {
-            public:
-                struct BinaryTree {
-                    Token token;
-                    double value;
-                    BinaryTree* left;
-                    BinaryTree* right;
+        static bool isVariable(std::string_view token);
+
+        static bool isFunction(std::string_view token);
+
+        static double parseNumber(std::string_view token);
+
+        static Expression::Kind operationKind(char op);
 
-                    explicit BinaryTree(const Token& token);
-                };
+        static Expression::Kind functionKind(std::string_view name);
 
-                explicit PolishNotationFunction(BinaryTree* root);
+        static Expression::Index parseTree(std::vector<Token>::const_iterator& begin,
+                                           std::vector<Token>::const_iterator end,
+                                           Expression& expression);
+
+        static Expression optimize(const Expression& parsed);
+
+        class PolishNotationFunction final : public ParsedFunction {
+            public:
+                PolishNotationFunction(Expression expression, bool jitEnabled,
+                                       vector_math::Accuracy accuracy);
 
                 ~PolishNotationFunction() override;
 
                 double operator()(double x) const override;
 
-            private:
-                static void walkDelete(const BinaryTree* node);
+                void evaluate(const double* xs, double* ys, std::size_t count) const override;
 
-                static double eval(const BinaryTree* node, double x);
+                ParsedFunction* derivative() const override;
 
-                BinaryTree* tree;
-        };
+                std::optional<Interval> enclose(double xMin, double xMax) const override;
 
-        static PolishNotationFunction::BinaryTree* parseTree(
-            std::vector<Token>::const_iterator& begin, std::vector<Token>::const_iterator& end);
+            private:
+                bool jitEnabled;
+                vector_math::Accuracy accuracy;
+                Expression expression;
+                Bytecode program;
+                std::unique_ptr<JitCode> native;
+        };
 
         class ConstFunction final : public ParsedFunction {
             public:
-                explicit ConstFunction(const std::vector<Token>& tokens);
+                explicit ConstFunction(double value);
 
                 ~ConstFunction() override;
 
                 double operator()(double x) const override;
 
+                void evaluate(const double* xs, double* ys, std::size_t count) const override;
+
+                ParsedFunction* derivative() const override;
+
+                std::optional<Interval> enclose(double xMin, double xMax) const override;
+
             private:
                 double value;
-
-                static double eval(std::vector<Token>::const_iterator& begin,
-                                   std::vector<Token>::const_iterator& end);
         };
 };
 
@@ -0,0 +1,259 @@
+#include "interval.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr double INF = INFINITY;
+
+    /**
+     * @brief Rounds the bounds outward by one ulp, so rounding errors of the operation that
+     * produced them cannot make the interval miss a value
+     */
+    Interval outward(const double lower, const double upper, const bool defined) {
+        if (std::isnan(lower) || std::isnan(upper)) {
+            return Interval::entire();
+        }
+        return {std::nextafter(lower, -INF), std::nextafter(upper, INF), defined};
+    }
+
+    /**
+     * Products of bounds for enclosure purposes: a zero factor bounds the product by zero even
+     * when the other factor is infinite (the infinite product itself would be NaN, which no
+     * interval has to enclose)
+     */
+    double boundProduct(const double a, const double b) {
+        return a == 0 || b == 0 ? 0 : a * b;
+    }
+
+    bool isInteger(const double value) {
+        return std::trunc(value) == value && std::abs(value) < 0x1p53;
+    }
+
+    /**
+     * Beyond this magnitude the extrema of periodic functions are not located reliably
+     */
+    constexpr double PERIODIC_LIMIT = 1e8;
+    constexpr double PERIODIC_SLACK = 1e-9;
+
+    /**
+     * @brief Checks whether some point offset + k * period lies in [lower, upper], erring on
+     * the side of finding one, which only widens the enclosure
+     */
+    bool containsPeriodic(const double lower, const double upper, const double offset,
+                          const double period) {
+        const double k = std::ceil((lower - offset) / period - PERIODIC_SLACK);
+        return offset + k * period <= upper + PERIODIC_SLACK;
+    }
+
+    /**
+     * @brief Encloses a sine wave shifted so that its maxima lie at maximum + 2k*pi
+     */
+    Interval encloseWave(const Interval& argument, const double lower, const double upper,
+                         const double maximum) {
+        if (argument.isEmpty()) {
+            return Interval::empty();
+        }
+        if (!argument.isFinite() || argument.upper - argument.lower >= 2 * M_PI ||
+            std::max(-argument.lower, argument.upper) > PERIODIC_LIMIT) {
+            return {-1, 1, argument.defined && argument.isFinite()};
+        }
+        const double low = containsPeriodic(argument.lower, argument.upper, maximum + M_PI,
+                                            2 * M_PI)
+                               ? -1
+                               : std::nextafter(std::min(lower, upper), -INF);
+        const double high = containsPeriodic(argument.lower, argument.upper, maximum, 2 * M_PI)
+                                ? 1
+                                : std::nextafter(std::max(lower, upper), INF);
+        return {std::max(low, -1.0), std::min(high, 1.0), argument.defined};
+    }
+}
+
+Interval Interval::point(const double value) {
+    if (std::isnan(value)) {
+        return empty();
+    }
+    return {value, value, true};
+}
+
+Interval Interval::entire() {
+    return {-INF, INF, false};
+}
+
+Interval Interval::empty() {
+    return {INF, -INF, false};
+}
+
+bool Interval::isEmpty() const {
+    return !(lower <= upper);
+}
+
+bool Interval::isFinite() const {
+    return !isEmpty() && std::isfinite(lower) && std::isfinite(upper);
+}
+
+bool Interval::contains(const double value) const {
+    return lower <= value && value <= upper;
+}
+
+Interval Interval::operator+(const Interval& other) const {
+    if (isEmpty() || other.isEmpty()) {
+        return empty();
+    }
+    return outward(lower + other.lower, upper + other.upper,
+                   defined && other.defined && (isFinite() || other.isFinite()));
+}
+
+Interval Interval::operator-(const Interval& other) const {
+    if (isEmpty() || other.isEmpty()) {
+        return empty();
+    }
+    return outward(lower - other.upper, upper - other.lower,
+                   defined && other.defined && (isFinite() || other.isFinite()));
+}
+
+Interval Interval::operator*(const Interval& other) const {
+    if (isEmpty() || other.isEmpty()) {
+        return empty();
+    }
+    const double products[4] = {
+        boundProduct(lower, other.lower), boundProduct(lower, other.upper),
+        boundProduct(upper, other.lower), boundProduct(upper, other.upper)
+    };
+    const bool zeroTimesInfinity = (contains(0) && !other.isFinite()) ||
+                                   (other.contains(0) && !isFinite());
+    return outward(*std::min_element(products, products + 4),
+                   *std::max_element(products, products + 4),
+                   defined && other.defined && !zeroTimesInfinity);
+}
+
+Interval Interval::operator/(const Interval& other) const {
+    if (isEmpty() || other.isEmpty()) {
+        return empty();
+    }
+    if (other.contains(0)) {
+        return entire();
+    }
+    // rounded outward itself, as the product only widens by the rounding of its own result
+    const Interval reciprocal = outward(1 / other.upper, 1 / other.lower, other.defined);
+    Interval quotient = *this * reciprocal;
+    quotient.defined = quotient.defined && (isFinite() || other.isFinite());
+    return quotient;
+}
+
+Interval Interval::pow(const Interval& exponent) const {
+    if (isEmpty() || exponent.isEmpty()) {
+        return empty();
+    }
+    if (exponent.lower == exponent.upper) {
+        const double c = exponent.lower;
+        if (c == 0) {
+            return point(1);
+        }
+        if (isInteger(c)) {
+            if (c < 0) {
+                return point(1) / pow(point(-c));
+            }
+            if (std::fmod(c, 2) != 0) {
+                return outward(std::pow(lower, c), std::pow(upper, c), defined);
+            }
+            const double nearest = contains(0) ? 0 : std::min(std::abs(lower), std::abs(upper));
+            const double farthest = std::max(std::abs(lower), std::abs(upper));
+            return outward(std::pow(nearest, c), std::pow(farthest, c), defined);
+        }
+        // fractional powers of negative bases are NaN
+        if (upper < 0) {
+            return empty();
+        }
+        const double base[2] = {std::max(lower, 0.0), upper};
+        const bool baseDefined = defined && lower >= 0;
+        return c > 0
+                   ? outward(std::pow(base[0], c), std::pow(base[1], c), baseDefined)
+                   : outward(std::pow(base[1], c), std::pow(base[0], c), baseDefined);
+    }
+    if (lower == upper && lower > 0) {
+        const double k = lower;
+        if (k == 1) {
+            return point(1);
+        }
+        return k > 1
+                   ? outward(std::pow(k, exponent.lower), std::pow(k, exponent.upper),
+                             exponent.defined)
+                   : outward(std::pow(k, exponent.upper), std::pow(k, exponent.lower),
+                             exponent.defined);
+    }
+    if (lower > 0 && isFinite() && exponent.isFinite()) {
+        const double powers[4] = {
+            std::pow(lower, exponent.lower), std::pow(lower, exponent.upper),
+            std::pow(upper, exponent.lower), std::pow(upper, exponent.upper)
+        };
+        return outward(*std::min_element(powers, powers + 4),
+                       *std::max_element(powers, powers + 4), defined && exponent.defined);
+    }
+    return entire();
+}
+
+Interval Interval::sin() const {
+    return encloseWave(*this, std::sin(lower), std::sin(upper), M_PI_2);
+}
+
+Interval Interval::cos() const {
+    return encloseWave(*this, std::cos(lower), std::cos(upper), 0);
+}
+
+Interval Interval::tan() const {
+    if (isEmpty()) {
+        return empty();
+    }
+    if (!isFinite() || upper - lower >= M_PI || std::max(-lower, upper) > PERIODIC_LIMIT ||
+        containsPeriodic(lower, upper, M_PI_2, M_PI)) {
+        return {-INF, INF, defined && isFinite()};
+    }
+    return outward(std::tan(lower), std::tan(upper), defined);
+}
+
+Interval Interval::exp() const {
+    if (isEmpty()) {
+        return empty();
+    }
+    return outward(std::exp(lower), std::exp(upper), defined);
+}
+
+/**
+ * Logarithms of negative numbers are NaN, of zero -infinity
+ */
+Interval Interval::log() const {
+    if (isEmpty() || upper < 0) {
+        return empty();
+    }
+    return outward(std::log(std::max(lower, 0.0)), std::log(upper), defined && lower >= 0);
+}
+
+Interval Interval::sqrt() const {
+    if (isEmpty() || upper < 0) {
+        return empty();
+    }
+    return outward(std::sqrt(std::max(lower, 0.0)), std::sqrt(upper), defined && lower >= 0);
+}
+
+Interval Interval::abs() const {
+    if (isEmpty()) {
+        return empty();
+    }
+    if (contains(0)) {
+        return {0, std::max(-lower, upper), defined};
+    }
+    return lower > 0 ? *this : Interval{-upper, -lower, defined};
+}
+
+Interval Interval::hull(const Interval& other) const {
+    if (isEmpty()) {
+        return other;
+    }
+    if (other.isEmpty()) {
+        return *this;
+    }
+    return {
+        std::min(lower, other.lower), std::max(upper, other.upper), defined && other.defined
+    };
+}
@@ -0,0 +1,56 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+/**
+ * A closed range enclosing every non-NaN value a function takes over a domain.
+ * lower > upper denotes the empty range, produced where the function is nowhere defined.
+ * defined - whether the function is guaranteed not to produce NaN over the domain
+ */
+struct Interval {
+    double lower;
+    double upper;
+    bool defined;
+
+    static Interval point(double value);
+
+    static Interval entire();
+
+    static Interval empty();
+
+    bool isEmpty() const;
+
+    bool isFinite() const;
+
+    bool contains(double value) const;
+
+    Interval operator+(const Interval& other) const;
+
+    Interval operator-(const Interval& other) const;
+
+    Interval operator*(const Interval& other) const;
+
+    Interval operator/(const Interval& other) const;
+
+    /**
+     * @brief Encloses std::pow over every combination of base and exponent from the intervals
+     */
+    Interval pow(const Interval& exponent) const;
+
+    Interval sin() const;
+
+    Interval cos() const;
+
+    Interval tan() const;
+
+    Interval exp() const;
+
+    Interval log() const;
+
+    Interval sqrt() const;
+
+    Interval abs() const;
+
+    Interval hull(const Interval& other) const;
+};
+
+#endif //INTERVAL_H
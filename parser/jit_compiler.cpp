@@ -0,0 +1,429 @@
+#include "jit_compiler.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__) && defined(__GNUC__)
+#define JIT_AVAILABLE 1
+#include <sys/mman.h>
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+namespace {
+    // ymm0 holds the arguments, ymm1..ymm14 hold the value stack, ymm15 is left for scratch
+    constexpr size_t MAX_STACK_DEPTH = 14;
+    constexpr unsigned SCRATCH = 15;
+    constexpr unsigned VECTOR_BYTES = 32;
+    // higher degrees run faster in the interpreter, which interleaves several vectors
+    constexpr size_t MAX_POLYNOMIAL_DEGREE = 16;
+
+    constexpr unsigned RSP = 4;
+    constexpr unsigned RSI = 6;
+    constexpr unsigned RDI = 7;
+
+    constexpr unsigned MAP_0F = 1;
+    constexpr unsigned MAP_0F38 = 2;
+    constexpr unsigned PREFIX_66 = 1;
+    constexpr unsigned PREFIX_F2 = 3;
+
+    /**
+     * Emits the handful of SysV x86-64 instructions the translation needs.
+     * Vector instructions are VEX encoded; packed forms work on ymm registers,
+     * scalar forms on the low double of xmm registers.
+     */
+    class Assembler {
+        public:
+            std::vector<std::uint8_t> code;
+
+            void bytes(std::initializer_list<std::uint8_t> values) {
+                code.insert(code.end(), values);
+            }
+
+            void arithmetic(const std::uint8_t opCode, const unsigned destination,
+                            const unsigned left, const unsigned right, const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, destination, right, left);
+                bytes({opCode, registers(destination, right)});
+            }
+
+            void squareRoot(const unsigned destination, const unsigned source,
+                            const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, destination, source,
+                    packed ? 0 : destination);
+                bytes({0x51, registers(destination, source)});
+            }
+
+            void bitwiseAnd(const unsigned destination, const unsigned left, const unsigned right,
+                            const bool packed) {
+                vex(MAP_0F, PREFIX_66, packed, destination, right, left);
+                bytes({0x54, registers(destination, right)});
+            }
+
+            void move(const unsigned destination, const unsigned source) {
+                vex(MAP_0F, PREFIX_66, true, destination, source, 0);
+                bytes({0x28, registers(destination, source)});
+            }
+
+            void loadConstant(const unsigned destination, const size_t constant,
+                              const bool packed) {
+                if (packed) {
+                    vex(MAP_0F38, PREFIX_66, true, destination, 0, 0);
+                    bytes({0x19});
+                } else {
+                    vex(MAP_0F, PREFIX_F2, false, destination, 0, 0);
+                    bytes({0x10});
+                }
+                bytes({static_cast<std::uint8_t>(0x05 | (destination & 7) << 3)});
+                constantFixups.emplace_back(code.size(), constant);
+                dword(0);
+            }
+
+            void load(const unsigned destination, const unsigned base, const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, destination, base, 0);
+                bytes({0x10, static_cast<std::uint8_t>((destination & 7) << 3 | base)});
+            }
+
+            void store(const unsigned source, const unsigned base, const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, source, base, 0);
+                bytes({0x11, static_cast<std::uint8_t>((source & 7) << 3 | base)});
+            }
+
+            void loadTemporary(const unsigned destination, const std::uint32_t slot,
+                               const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, destination, RSP, 0);
+                stackOperand(0x10, destination, slot);
+            }
+
+            void storeTemporary(const unsigned source, const std::uint32_t slot,
+                                const bool packed) {
+                vex(MAP_0F, packed ? PREFIX_66 : PREFIX_F2, packed, source, RSP, 0);
+                stackOperand(0x11, source, slot);
+            }
+
+            void dword(const std::uint32_t value) {
+                for (unsigned i = 0; i < 4; ++i) {
+                    code.push_back(static_cast<std::uint8_t>(value >> 8 * i));
+                }
+            }
+
+            /**
+             * @brief Emits a jump with a 32-bit displacement to be patched by bind()
+             * @return position of the displacement
+             */
+            size_t jump(std::initializer_list<std::uint8_t> opCode) {
+                bytes(opCode);
+                dword(0);
+                return code.size() - 4;
+            }
+
+            void bind(const size_t displacement, const size_t target) {
+                patch(displacement, static_cast<std::int64_t>(target) -
+                                    static_cast<std::int64_t>(displacement + 4));
+            }
+
+            /**
+             * @brief Appends the constant pool after the code and resolves RIP-relative loads
+             */
+            void appendConstants(const std::vector<double>& constants) {
+                while (code.size() % sizeof(double) != 0) {
+                    code.push_back(0xCC);
+                }
+                const size_t pool = code.size();
+                code.resize(pool + constants.size() * sizeof(double));
+                std::memcpy(code.data() + pool, constants.data(),
+                            constants.size() * sizeof(double));
+                for (const auto& [displacement, constant] : constantFixups) {
+                    const size_t address = pool + constant * sizeof(double);
+                    patch(displacement, static_cast<std::int64_t>(address) -
+                                        static_cast<std::int64_t>(displacement + 4));
+                }
+            }
+
+        private:
+            std::vector<std::pair<size_t, size_t> > constantFixups;
+
+            /**
+             * Three byte VEX prefix; register numbers are inverted in the encoding,
+             * so an unused vvvv field is passed as 0.
+             */
+            void vex(const unsigned map, const unsigned prefix, const bool wide,
+                     const unsigned reg, const unsigned rm, const unsigned vvvv) {
+                bytes({
+                    0xC4,
+                    static_cast<std::uint8_t>((~reg >> 3 & 1) << 7 | 1 << 6 | (~rm >> 3 & 1) << 5 |
+                                              map),
+                    static_cast<std::uint8_t>((~vvvv & 0xF) << 3 | (wide ? 1 : 0) << 2 | prefix)
+                });
+            }
+
+            static std::uint8_t registers(const unsigned reg, const unsigned rm) {
+                return static_cast<std::uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7));
+            }
+
+            void stackOperand(const std::uint8_t opCode, const unsigned reg,
+                              const std::uint32_t slot) {
+                bytes({opCode, static_cast<std::uint8_t>(0x84 | (reg & 7) << 3), 0x24});
+                dword(slot * VECTOR_BYTES);
+            }
+
+            void patch(const size_t position, const std::int64_t value) {
+                const auto displacement =
+                    static_cast<std::uint32_t>(static_cast<std::int32_t>(value));
+                for (unsigned i = 0; i < 4; ++i) {
+                    code[position + i] = static_cast<std::uint8_t>(displacement >> 8 * i);
+                }
+            }
+    };
+
+    bool translatable(const Bytecode& program) {
+        if (program.stackDepth() > MAX_STACK_DEPTH) {
+            return false;
+        }
+        for (const auto& instruction : program.instructions()) {
+            switch (instruction.opCode) {
+                case Bytecode::OpCode::POWER:
+                case Bytecode::OpCode::SIN:
+                case Bytecode::OpCode::COS:
+                case Bytecode::OpCode::TAN:
+                case Bytecode::OpCode::EXP:
+                case Bytecode::OpCode::LOG:
+                    return false;
+                case Bytecode::OpCode::PUSH_POLYNOMIAL:
+                    if (program.polynomials()[instruction.operand].degree >
+                        MAX_POLYNOMIAL_DEGREE) {
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Evaluates a polynomial of ymm0 into a register. Splits it into even and odd
+     * coefficients in powers of x^2 evaluated in the two registers above the destination, when
+     * they are free, for two independent chains of operations starting from their highest nonzero
+     * coefficients, as the interpreter does, and uses Horner's rule otherwise
+     */
+    void emitPolynomial(Assembler& assembler, const unsigned reg,
+                        const Bytecode::Polynomial& polynomial, const bool packed) {
+        const size_t offset = polynomial.offset;
+        const size_t degree = polynomial.degree;
+        if (reg + 2 > MAX_STACK_DEPTH || degree < 2) {
+            assembler.loadConstant(reg, offset + degree, packed);
+            for (size_t i = degree; i-- > 0;) {
+                assembler.arithmetic(0x59, reg, reg, 0, packed);
+                assembler.loadConstant(SCRATCH, offset + i, packed);
+                assembler.arithmetic(0x58, reg, reg, SCRATCH, packed);
+            }
+            return;
+        }
+        const unsigned odd = reg + 1;
+        const unsigned square = reg + 2;
+        const size_t evenSteps = polynomial.evenDegree / 2;
+        const size_t oddSteps = polynomial.oddDegree / 2;
+        assembler.arithmetic(0x59, square, 0, 0, packed);
+        assembler.loadConstant(reg, offset + polynomial.evenDegree, packed);
+        assembler.loadConstant(odd, offset + polynomial.oddDegree, packed);
+        for (size_t step = std::max(evenSteps, oddSteps); step >= 1; --step) {
+            if (step <= evenSteps) {
+                assembler.arithmetic(0x59, reg, reg, square, packed);
+                assembler.loadConstant(SCRATCH, offset + 2 * step - 2, packed);
+                assembler.arithmetic(0x58, reg, reg, SCRATCH, packed);
+            }
+            if (step <= oddSteps) {
+                assembler.arithmetic(0x59, odd, odd, square, packed);
+                assembler.loadConstant(SCRATCH, offset + 2 * step - 1, packed);
+                assembler.arithmetic(0x58, odd, odd, SCRATCH, packed);
+            }
+        }
+        if (polynomial.oddDegree != 0) {
+            assembler.arithmetic(0x59, odd, odd, 0, packed);
+            assembler.arithmetic(0x58, reg, reg, odd, packed);
+        }
+    }
+
+    /**
+     * @brief Raises a register to an integer power by left-to-right binary exponentiation
+     * @param one index of the constant 1.0
+     */
+    void emitIntegerPower(Assembler& assembler, const unsigned reg, const int exponent,
+                          const size_t one, const bool packed) {
+        const unsigned magnitude = static_cast<unsigned>(exponent < 0 ? -exponent : exponent);
+        if (magnitude == 0) {
+            assembler.loadConstant(reg, one, packed);
+            return;
+        }
+        assembler.move(SCRATCH, reg);
+        for (int bit = 30 - __builtin_clz(magnitude); bit >= 0; --bit) {
+            assembler.arithmetic(0x59, SCRATCH, SCRATCH, SCRATCH, packed);
+            if (magnitude >> bit & 1) {
+                assembler.arithmetic(0x59, SCRATCH, SCRATCH, reg, packed);
+            }
+        }
+        if (exponent < 0) {
+            assembler.loadConstant(reg, one, packed);
+            assembler.arithmetic(0x5E, reg, reg, SCRATCH, packed);
+        } else {
+            assembler.move(reg, SCRATCH);
+        }
+    }
+
+    /**
+     * @brief Emits the body computing one vector (or one scalar) of results from ymm0 into ymm1
+     * @param absMask index of the constant clearing the sign bit
+     * @param one index of the constant 1.0
+     */
+    void emitBody(Assembler& assembler, const Bytecode& program, const size_t absMask,
+                  const size_t one, const bool packed) {
+        unsigned depth = 0;
+        for (const auto& instruction : program.instructions()) {
+            switch (instruction.opCode) {
+                case Bytecode::OpCode::PUSH_CONSTANT:
+                    assembler.loadConstant(++depth, instruction.operand, packed);
+                    break;
+                case Bytecode::OpCode::PUSH_VARIABLE:
+                    assembler.move(++depth, 0);
+                    break;
+                case Bytecode::OpCode::PUSH_POLYNOMIAL:
+                    emitPolynomial(assembler, ++depth, program.polynomials()[instruction.operand],
+                                   packed);
+                    break;
+                case Bytecode::OpCode::INTEGER_POWER:
+                    emitIntegerPower(assembler, depth,
+                                     static_cast<std::int32_t>(instruction.operand), one, packed);
+                    break;
+                case Bytecode::OpCode::STORE:
+                    assembler.storeTemporary(depth, instruction.operand, packed);
+                    break;
+                case Bytecode::OpCode::LOAD:
+                    assembler.loadTemporary(++depth, instruction.operand, packed);
+                    break;
+                case Bytecode::OpCode::ADD:
+                    --depth;
+                    assembler.arithmetic(0x58, depth, depth, depth + 1, packed);
+                    break;
+                case Bytecode::OpCode::SUBTRACT:
+                    --depth;
+                    assembler.arithmetic(0x5C, depth, depth, depth + 1, packed);
+                    break;
+                case Bytecode::OpCode::MULTIPLY:
+                    --depth;
+                    assembler.arithmetic(0x59, depth, depth, depth + 1, packed);
+                    break;
+                case Bytecode::OpCode::DIVIDE:
+                    --depth;
+                    assembler.arithmetic(0x5E, depth, depth, depth + 1, packed);
+                    break;
+                case Bytecode::OpCode::SQRT:
+                    assembler.squareRoot(depth, depth, packed);
+                    break;
+                case Bytecode::OpCode::ABS:
+                    assembler.loadConstant(SCRATCH, absMask, packed);
+                    assembler.bitwiseAnd(depth, depth, SCRATCH, packed);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    /**
+     * void f(const double* xs [rdi], double* ys [rsi], size_t count [rdx])
+     */
+    std::vector<std::uint8_t> translate(const Bytecode& program) {
+        std::vector<double> constants = program.constants();
+        const size_t absMask = constants.size();
+        constexpr std::uint64_t absMaskBits = 0x7FFFFFFFFFFFFFFFULL;
+        constants.emplace_back();
+        std::memcpy(&constants.back(), &absMaskBits, sizeof(double));
+        const size_t one = constants.size();
+        constants.push_back(1.0);
+
+        Assembler assembler;
+        const auto frame = static_cast<std::uint32_t>(program.temporaries() * VECTOR_BYTES);
+        if (frame != 0) {
+            assembler.bytes({0x48, 0x81, 0xEC}); // sub rsp, frame
+            assembler.dword(frame);
+        }
+
+        const size_t packedLoop = assembler.code.size();
+        assembler.bytes({0x48, 0x83, 0xFA, 0x04}); // cmp rdx, 4
+        const size_t toScalarLoop = assembler.jump({0x0F, 0x82}); // jb
+        assembler.load(0, RDI, true);
+        emitBody(assembler, program, absMask, one, true);
+        assembler.store(1, RSI, true);
+        assembler.bytes({0x48, 0x83, 0xC7, 0x20}); // add rdi, 32
+        assembler.bytes({0x48, 0x83, 0xC6, 0x20}); // add rsi, 32
+        assembler.bytes({0x48, 0x83, 0xEA, 0x04}); // sub rdx, 4
+        assembler.bind(assembler.jump({0xE9}), packedLoop);
+
+        const size_t scalarLoop = assembler.code.size();
+        assembler.bind(toScalarLoop, scalarLoop);
+        assembler.bytes({0x48, 0x85, 0xD2}); // test rdx, rdx
+        const size_t toEpilogue = assembler.jump({0x0F, 0x84}); // jz
+        assembler.load(0, RDI, false);
+        emitBody(assembler, program, absMask, one, false);
+        assembler.store(1, RSI, false);
+        assembler.bytes({0x48, 0x83, 0xC7, 0x08}); // add rdi, 8
+        assembler.bytes({0x48, 0x83, 0xC6, 0x08}); // add rsi, 8
+        assembler.bytes({0x48, 0xFF, 0xCA}); // dec rdx
+        assembler.bind(assembler.jump({0xE9}), scalarLoop);
+
+        assembler.bind(toEpilogue, assembler.code.size());
+        if (frame != 0) {
+            assembler.bytes({0x48, 0x81, 0xC4}); // add rsp, frame
+            assembler.dword(frame);
+        }
+        assembler.bytes({0xC5, 0xF8, 0x77}); // vzeroupper
+        assembler.bytes({0xC3}); // ret
+        assembler.appendConstants(constants);
+        return std::move(assembler.code);
+    }
+}
+
+JitCode::JitCode(void* memory, const size_t size): memory(memory), size(size),
+                                                   entry(reinterpret_cast<Entry>(memory)) { }
+
+JitCode::~JitCode() {
+#if JIT_AVAILABLE
+    munmap(memory, size);
+#endif
+}
+
+bool JitCode::supported() {
+#if JIT_AVAILABLE
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<JitCode> JitCode::compile(const Bytecode& program) {
+#if JIT_AVAILABLE
+    if (!supported() || !translatable(program)) {
+        return nullptr;
+    }
+    const std::vector<std::uint8_t> code = translate(program);
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return nullptr;
+    }
+    return std::unique_ptr<JitCode>(new JitCode(memory, code.size()));
+#else
+    return nullptr;
+#endif
+}
+
+void JitCode::operator()(const double* xs, double* ys, const size_t count) const {
+    entry(xs, ys, count);
+}
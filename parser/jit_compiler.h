@@ -0,0 +1,46 @@
+#ifndef JIT_COMPILER_H
+#define JIT_COMPILER_H
+#include <cstddef>
+#include <memory>
+
+#include "bytecode.h"
+
+/**
+ * Native x86-64 code compiled from a bytecode program, living in its own executable mapping.
+ * The code processes four arguments per iteration with AVX2 packed doubles and finishes the
+ * remainder with scalar instructions.
+ */
+class JitCode {
+    public:
+        using Entry = void (*)(const double* xs, double* ys, size_t count);
+
+        JitCode(const JitCode&) = delete;
+
+        JitCode& operator=(const JitCode&) = delete;
+
+        ~JitCode();
+
+        /**
+         * @return whether native code can be generated and executed on this machine
+         */
+        static bool supported();
+
+        /**
+         * @brief Translates a program to native code
+         * @param program compiled program
+         * @return native code, or nullptr if the machine or some instruction of the program is not
+         * supported
+         */
+        static std::unique_ptr<JitCode> compile(const Bytecode& program);
+
+        void operator()(const double* xs, double* ys, size_t count) const;
+
+    private:
+        void* memory;
+        size_t size;
+        Entry entry;
+
+        JitCode(void* memory, size_t size);
+};
+
+#endif //JIT_COMPILER_H
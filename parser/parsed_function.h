@@ -4,12 +4,47 @@
 
 #ifndef PARSED_FUNCTION_H
 #define PARSED_FUNCTION_H
+#include <cstddef>
+#include <optional>
+
+#include "interval.h"
 
 class ParsedFunction {
     public:
         virtual ~ParsedFunction() = default;
 
         virtual double operator()(double x) const = 0;
+
+        /**
+         * @brief Evaluates the function for a batch of arguments
+         * @param xs arguments
+         * @param ys output array receiving values of the function, one per argument
+         * @param count number of arguments
+         */
+        virtual void evaluate(const double* xs, double* ys, std::size_t count) const {
+            for (std::size_t i = 0; i < count; ++i) {
+                ys[i] = (*this)(xs[i]);
+            }
+        }
+
+        /**
+         * @return a new function computing the exact derivative of this function, or nullptr if
+         * the function cannot be differentiated symbolically
+         */
+        virtual ParsedFunction* derivative() const {
+            return nullptr;
+        }
+
+        /**
+         * @brief Bounds the values of the function over a domain without sampling it
+         * @param xMin The left bound of the domain
+         * @param xMax The right bound of the domain
+         * @return guaranteed enclosure of the values, or nothing if the function cannot be
+         * analysed
+         */
+        virtual std::optional<Interval> enclose(double /*xMin*/, double /*xMax*/) const {
+            return std::nullopt;
+        }
 };
 
 #endif //PARSED_FUNCTION_H
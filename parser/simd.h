@@ -0,0 +1,210 @@
+#ifndef SIMD_H
+#define SIMD_H
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <cmath>
+#include <cstring>
+#endif
+
+/**
+ * Thin wrapper over the widest packed-double registers the translation unit is compiled for:
+ * AVX2 (4 lanes), SSE2 (2 lanes) or plain scalars (1 lane).
+ * Comparisons return masks with all bits of a lane set where they hold; bitmask packs them into
+ * one bit per lane, the first lane lowest. The bitwise and shift operations treat each lane as a
+ * 64-bit integer.
+ */
+namespace simd {
+#if defined(__AVX2__)
+    using Vec = __m256d;
+    constexpr std::size_t LANES = 4;
+
+    inline Vec load(const double* p) { return _mm256_loadu_pd(p); }
+
+    inline void store(double* p, const Vec v) { _mm256_storeu_pd(p, v); }
+
+    inline Vec broadcast(const double d) { return _mm256_set1_pd(d); }
+
+    inline Vec add(const Vec a, const Vec b) { return _mm256_add_pd(a, b); }
+
+    inline Vec sub(const Vec a, const Vec b) { return _mm256_sub_pd(a, b); }
+
+    inline Vec mul(const Vec a, const Vec b) { return _mm256_mul_pd(a, b); }
+
+    inline Vec div(const Vec a, const Vec b) { return _mm256_div_pd(a, b); }
+
+    inline Vec sqrt(const Vec a) { return _mm256_sqrt_pd(a); }
+
+    inline Vec fromBits(const std::uint64_t bits) {
+        return _mm256_castsi256_pd(_mm256_set1_epi64x(static_cast<long long>(bits)));
+    }
+
+    inline Vec bitAnd(const Vec a, const Vec b) { return _mm256_and_pd(a, b); }
+
+    inline Vec bitOr(const Vec a, const Vec b) { return _mm256_or_pd(a, b); }
+
+    inline Vec bitXor(const Vec a, const Vec b) { return _mm256_xor_pd(a, b); }
+
+    inline Vec shiftLeft(const Vec a, const int bits) {
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), bits));
+    }
+
+    inline Vec shiftRight(const Vec a, const int bits) {
+        return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), bits));
+    }
+
+    inline Vec abs(const Vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+
+    inline Vec round(const Vec a) {
+        return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+
+    inline Vec floor(const Vec a) { return _mm256_floor_pd(a); }
+
+    inline Vec less(const Vec a, const Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+
+    inline Vec lessEqual(const Vec a, const Vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+
+    inline Vec equal(const Vec a, const Vec b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+
+    inline Vec select(const Vec mask, const Vec a, const Vec b) {
+        return _mm256_blendv_pd(b, a, mask);
+    }
+
+    inline bool all(const Vec mask) { return _mm256_movemask_pd(mask) == 0xF; }
+
+    inline unsigned bitmask(const Vec mask) { return _mm256_movemask_pd(mask); }
+#elif defined(__SSE2__)
+    using Vec = __m128d;
+    constexpr std::size_t LANES = 2;
+
+    inline Vec load(const double* p) { return _mm_loadu_pd(p); }
+
+    inline void store(double* p, const Vec v) { _mm_storeu_pd(p, v); }
+
+    inline Vec broadcast(const double d) { return _mm_set1_pd(d); }
+
+    inline Vec add(const Vec a, const Vec b) { return _mm_add_pd(a, b); }
+
+    inline Vec sub(const Vec a, const Vec b) { return _mm_sub_pd(a, b); }
+
+    inline Vec mul(const Vec a, const Vec b) { return _mm_mul_pd(a, b); }
+
+    inline Vec div(const Vec a, const Vec b) { return _mm_div_pd(a, b); }
+
+    inline Vec sqrt(const Vec a) { return _mm_sqrt_pd(a); }
+
+    inline Vec fromBits(const std::uint64_t bits) {
+        return _mm_castsi128_pd(_mm_set1_epi64x(static_cast<long long>(bits)));
+    }
+
+    inline Vec bitAnd(const Vec a, const Vec b) { return _mm_and_pd(a, b); }
+
+    inline Vec bitOr(const Vec a, const Vec b) { return _mm_or_pd(a, b); }
+
+    inline Vec bitXor(const Vec a, const Vec b) { return _mm_xor_pd(a, b); }
+
+    inline Vec shiftLeft(const Vec a, const int bits) {
+        return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), bits));
+    }
+
+    inline Vec shiftRight(const Vec a, const int bits) {
+        return _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(a), bits));
+    }
+
+    inline Vec abs(const Vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+
+    /**
+     * Rounds to nearest by pushing the fraction out of the mantissa, exact for |a| < 2^51
+     */
+    inline Vec round(const Vec a) {
+        const Vec shift = _mm_set1_pd(0x1.8p52);
+        return _mm_sub_pd(_mm_add_pd(a, shift), shift);
+    }
+
+    inline Vec floor(const Vec a) {
+        const Vec rounded = round(a);
+        return _mm_sub_pd(rounded, _mm_and_pd(_mm_cmplt_pd(a, rounded), _mm_set1_pd(1.0)));
+    }
+
+    inline Vec less(const Vec a, const Vec b) { return _mm_cmplt_pd(a, b); }
+
+    inline Vec lessEqual(const Vec a, const Vec b) { return _mm_cmple_pd(a, b); }
+
+    inline Vec equal(const Vec a, const Vec b) { return _mm_cmpeq_pd(a, b); }
+
+    inline Vec select(const Vec mask, const Vec a, const Vec b) {
+        return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+    }
+
+    inline bool all(const Vec mask) { return _mm_movemask_pd(mask) == 0x3; }
+
+    inline unsigned bitmask(const Vec mask) { return _mm_movemask_pd(mask); }
+#else
+    using Vec = double;
+    constexpr std::size_t LANES = 1;
+
+    inline Vec load(const double* p) { return *p; }
+
+    inline void store(double* p, const Vec v) { *p = v; }
+
+    inline Vec broadcast(const double d) { return d; }
+
+    inline Vec add(const Vec a, const Vec b) { return a + b; }
+
+    inline Vec sub(const Vec a, const Vec b) { return a - b; }
+
+    inline Vec mul(const Vec a, const Vec b) { return a * b; }
+
+    inline Vec div(const Vec a, const Vec b) { return a / b; }
+
+    inline Vec sqrt(const Vec a) { return std::sqrt(a); }
+
+    inline std::uint64_t toBits(const Vec a) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &a, sizeof(bits));
+        return bits;
+    }
+
+    inline Vec fromBits(const std::uint64_t bits) {
+        Vec a;
+        std::memcpy(&a, &bits, sizeof(bits));
+        return a;
+    }
+
+    inline Vec bitAnd(const Vec a, const Vec b) { return fromBits(toBits(a) & toBits(b)); }
+
+    inline Vec bitOr(const Vec a, const Vec b) { return fromBits(toBits(a) | toBits(b)); }
+
+    inline Vec bitXor(const Vec a, const Vec b) { return fromBits(toBits(a) ^ toBits(b)); }
+
+    inline Vec shiftLeft(const Vec a, const int bits) { return fromBits(toBits(a) << bits); }
+
+    inline Vec shiftRight(const Vec a, const int bits) { return fromBits(toBits(a) >> bits); }
+
+    inline Vec abs(const Vec a) { return std::abs(a); }
+
+    inline Vec round(const Vec a) { return std::nearbyint(a); }
+
+    inline Vec floor(const Vec a) { return std::floor(a); }
+
+    inline Vec less(const Vec a, const Vec b) { return fromBits(a < b ? ~0ULL : 0); }
+
+    inline Vec lessEqual(const Vec a, const Vec b) { return fromBits(a <= b ? ~0ULL : 0); }
+
+    inline Vec equal(const Vec a, const Vec b) { return fromBits(a == b ? ~0ULL : 0); }
+
+    inline Vec select(const Vec mask, const Vec a, const Vec b) { return toBits(mask) ? a : b; }
+
+    inline bool all(const Vec mask) { return toBits(mask) != 0; }
+
+    inline unsigned bitmask(const Vec mask) { return toBits(mask) != 0; }
+#endif
+}
+
+#endif //SIMD_H
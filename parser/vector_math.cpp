@@ -0,0 +1,252 @@
+#include "vector_math.h"
+
+#include <cfloat>
+#include <cmath>
+
+#include "simd.h"
+
+namespace {
+    using simd::Vec;
+
+    /**
+     * pi/2 split into parts whose products with the quadrant index are exact, so the reduced
+     * argument loses no precision for |x| up to TRIGONOMETRIC_LIMIT
+     */
+    constexpr double PI_2_HIGH = 1.57079625129699707031e+00;
+    constexpr double PI_2_MIDDLE = 7.54978941586159635336e-08;
+    constexpr double PI_2_LOW = 5.39030285815811905290e-15;
+    constexpr double TRIGONOMETRIC_LIMIT = 1e5;
+
+    constexpr double LN2_HIGH = 6.93147180369123816490e-01;
+    constexpr double LN2_LOW = 1.90821492927058770002e-10;
+    constexpr double EXP_MIN = -708.0;
+    constexpr double EXP_MAX = 709.0;
+
+    /**
+     * Taylor coefficients of sin(r) = r + r * z * S(z) and cos(r) = 1 - z / 2 + z^2 * C(z) with
+     * z = r^2, truncated below 1e-16 for |r| <= pi/4
+     */
+    constexpr double SIN_COEFFICIENTS[] = {
+        -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800, 1.0 / 6227020800,
+        -1.0 / 1307674368000
+    };
+    constexpr double COS_COEFFICIENTS[] = {
+        1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800, 1.0 / 479001600,
+        -1.0 / 87178291200, 1.0 / 20922789888000
+    };
+    /**
+     * Taylor coefficients of exp(r), truncated below 1e-17 for |r| <= ln(2) / 2
+     */
+    constexpr double EXP_COEFFICIENTS[] = {
+        1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+        1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800
+    };
+    /**
+     * Minimax coefficients of (log(1 + f) - 2s) / s with s = f / (2 + f), in powers of s^2
+     */
+    constexpr double LOG_COEFFICIENTS[] = {
+        6.666666666666735130e-01, 3.999999999940941908e-01, 2.857142874366239149e-01,
+        2.222219843214978396e-01, 1.818357216161805012e-01, 1.531383769920937332e-01,
+        1.479819860511658591e-01
+    };
+
+    template <size_t N>
+    Vec horner(const Vec x, const double (&coefficients)[N]) {
+        Vec result = simd::broadcast(coefficients[N - 1]);
+        for (size_t i = N - 1; i-- > 0;) {
+            result = simd::add(simd::mul(result, x), simd::broadcast(coefficients[i]));
+        }
+        return result;
+    }
+
+    Vec negateWhere(const Vec mask, const Vec value) {
+        return simd::bitXor(value, simd::bitAnd(mask, simd::broadcast(-0.0)));
+    }
+
+    /**
+     * Reduces x to r = x - j * pi/2 with |r| <= pi/4
+     * @param quadrant receives j mod 4
+     */
+    void sinCos(const Vec x, Vec& sine, Vec& cosine, Vec& quadrant) {
+        const Vec j = simd::round(simd::mul(x, simd::broadcast(2 / M_PI)));
+        Vec r = simd::sub(x, simd::mul(j, simd::broadcast(PI_2_HIGH)));
+        r = simd::sub(r, simd::mul(j, simd::broadcast(PI_2_MIDDLE)));
+        r = simd::sub(r, simd::mul(j, simd::broadcast(PI_2_LOW)));
+        const Vec z = simd::mul(r, r);
+        sine = simd::add(r, simd::mul(simd::mul(r, z), horner(z, SIN_COEFFICIENTS)));
+        cosine = simd::add(simd::sub(simd::broadcast(1.0), simd::mul(z, simd::broadcast(0.5))),
+                           simd::mul(simd::mul(z, z), horner(z, COS_COEFFICIENTS)));
+        quadrant = simd::sub(j, simd::mul(simd::broadcast(4.0),
+                                          simd::floor(simd::mul(j, simd::broadcast(0.25)))));
+    }
+
+    Vec isOdd(const Vec quadrant) {
+        return simd::bitOr(simd::equal(quadrant, simd::broadcast(1.0)),
+                           simd::equal(quadrant, simd::broadcast(3.0)));
+    }
+
+    Vec trigonometricRange(const Vec x) {
+        return simd::lessEqual(simd::abs(x), simd::broadcast(TRIGONOMETRIC_LIMIT));
+    }
+
+    Vec sinKernel(const Vec x, Vec& inRange) {
+        inRange = trigonometricRange(x);
+        Vec sine, cosine, quadrant;
+        sinCos(x, sine, cosine, quadrant);
+        const Vec negative = simd::lessEqual(simd::broadcast(2.0), quadrant);
+        return negateWhere(negative, simd::select(isOdd(quadrant), cosine, sine));
+    }
+
+    Vec cosKernel(const Vec x, Vec& inRange) {
+        inRange = trigonometricRange(x);
+        Vec sine, cosine, quadrant;
+        sinCos(x, sine, cosine, quadrant);
+        const Vec negative = simd::bitAnd(simd::lessEqual(simd::broadcast(1.0), quadrant),
+                                          simd::lessEqual(quadrant, simd::broadcast(2.0)));
+        return negateWhere(negative, simd::select(isOdd(quadrant), sine, cosine));
+    }
+
+    Vec tanKernel(const Vec x, Vec& inRange) {
+        inRange = trigonometricRange(x);
+        Vec sine, cosine, quadrant;
+        sinCos(x, sine, cosine, quadrant);
+        const Vec odd = isOdd(quadrant);
+        return simd::div(simd::select(odd, negateWhere(odd, cosine), sine),
+                         simd::select(odd, sine, cosine));
+    }
+
+    /**
+     * exp(x) = exp(r) * 2^n with r = x - n * ln(2), the power of two being assembled directly
+     * in the exponent bits
+     */
+    Vec expKernel(const Vec x, Vec& inRange) {
+        inRange = simd::bitAnd(simd::lessEqual(simd::broadcast(EXP_MIN), x),
+                               simd::lessEqual(x, simd::broadcast(EXP_MAX)));
+        const Vec n = simd::round(simd::mul(x, simd::broadcast(1 / M_LN2)));
+        Vec r = simd::sub(x, simd::mul(n, simd::broadcast(LN2_HIGH)));
+        r = simd::sub(r, simd::mul(n, simd::broadcast(LN2_LOW)));
+        const Vec scale = simd::shiftLeft(simd::add(n, simd::broadcast(0x1p52 + 1023)), 52);
+        return simd::mul(horner(r, EXP_COEFFICIENTS), scale);
+    }
+
+    /**
+     * log(x) = e * ln(2) + log(m) with x = m * 2^e and m in [sqrt(2) / 2, sqrt(2))
+     */
+    Vec logKernel(const Vec x, Vec& inRange) {
+        inRange = simd::bitAnd(simd::lessEqual(simd::broadcast(DBL_MIN), x),
+                               simd::lessEqual(x, simd::broadcast(DBL_MAX)));
+        const Vec exponentBits = simd::bitOr(simd::shiftRight(x, 52),
+                                             simd::fromBits(0x4330000000000000ULL));
+        Vec e = simd::sub(exponentBits, simd::broadcast(0x1p52 + 1023));
+        Vec m = simd::bitOr(simd::bitAnd(x, simd::fromBits(0x000FFFFFFFFFFFFFULL)),
+                            simd::fromBits(0x3FF0000000000000ULL));
+        const Vec large = simd::less(simd::broadcast(M_SQRT2), m);
+        m = simd::select(large, simd::mul(m, simd::broadcast(0.5)), m);
+        e = simd::add(e, simd::bitAnd(large, simd::broadcast(1.0)));
+
+        const Vec f = simd::sub(m, simd::broadcast(1.0));
+        const Vec s = simd::div(f, simd::add(simd::broadcast(2.0), f));
+        const Vec z = simd::mul(s, s);
+        const Vec halfSquare = simd::mul(simd::broadcast(0.5), simd::mul(f, f));
+        const Vec remainder = simd::mul(z, horner(z, LOG_COEFFICIENTS));
+        const Vec correction = simd::add(simd::mul(s, simd::add(halfSquare, remainder)),
+                                         simd::mul(e, simd::broadcast(LN2_LOW)));
+        return simd::sub(simd::mul(e, simd::broadcast(LN2_HIGH)),
+                         simd::sub(simd::sub(halfSquare, correction), f));
+    }
+
+    /**
+     * Runs a kernel over whole vectors of values. Vectors with an argument outside of the range
+     * of the kernel, and the remainder shorter than a vector, are computed by the fallback.
+     */
+    template <typename Kernel, typename Fallback>
+    void apply(double* values, const size_t count, Kernel kernel, Fallback fallback) {
+        size_t i = 0;
+        for (; i + simd::LANES <= count; i += simd::LANES) {
+            Vec inRange;
+            const Vec result = kernel(simd::load(values + i), inRange);
+            if (simd::all(inRange)) {
+                simd::store(values + i, result);
+            } else {
+                for (size_t j = i; j < i + simd::LANES; ++j) {
+                    values[j] = fallback(values[j]);
+                }
+            }
+        }
+        for (; i < count; ++i) {
+            values[i] = fallback(values[i]);
+        }
+    }
+
+    template <typename Fallback>
+    void applyPrecise(double* values, const size_t count, Fallback fallback) {
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = fallback(values[i]);
+        }
+    }
+}
+
+void vector_math::sin(double* values, const std::size_t count, const Accuracy accuracy) {
+    const auto fallback = [](const double x) { return std::sin(x); };
+    if (accuracy == Accuracy::FAST) {
+        apply(values, count, sinKernel, fallback);
+    } else {
+        applyPrecise(values, count, fallback);
+    }
+}
+
+void vector_math::cos(double* values, const std::size_t count, const Accuracy accuracy) {
+    const auto fallback = [](const double x) { return std::cos(x); };
+    if (accuracy == Accuracy::FAST) {
+        apply(values, count, cosKernel, fallback);
+    } else {
+        applyPrecise(values, count, fallback);
+    }
+}
+
+void vector_math::tan(double* values, const std::size_t count, const Accuracy accuracy) {
+    const auto fallback = [](const double x) { return std::tan(x); };
+    if (accuracy == Accuracy::FAST) {
+        apply(values, count, tanKernel, fallback);
+    } else {
+        applyPrecise(values, count, fallback);
+    }
+}
+
+void vector_math::exp(double* values, const std::size_t count, const Accuracy accuracy) {
+    const auto fallback = [](const double x) { return std::exp(x); };
+    if (accuracy == Accuracy::FAST) {
+        apply(values, count, expKernel, fallback);
+    } else {
+        applyPrecise(values, count, fallback);
+    }
+}
+
+void vector_math::log(double* values, const std::size_t count, const Accuracy accuracy) {
+    const auto fallback = [](const double x) { return std::log(x); };
+    if (accuracy == Accuracy::FAST) {
+        apply(values, count, logKernel, fallback);
+    } else {
+        applyPrecise(values, count, fallback);
+    }
+}
+
+void vector_math::sqrt(double* values, const std::size_t count) {
+    size_t i = 0;
+    for (; i + simd::LANES <= count; i += simd::LANES) {
+        simd::store(values + i, simd::sqrt(simd::load(values + i)));
+    }
+    for (; i < count; ++i) {
+        values[i] = std::sqrt(values[i]);
+    }
+}
+
+void vector_math::abs(double* values, const std::size_t count) {
+    size_t i = 0;
+    for (; i + simd::LANES <= count; i += simd::LANES) {
+        simd::store(values + i, simd::abs(simd::load(values + i)));
+    }
+    for (; i < count; ++i) {
+        values[i] = std::abs(values[i]);
+    }
+}
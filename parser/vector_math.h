@@ -0,0 +1,33 @@
+#ifndef VECTOR_MATH_H
+#define VECTOR_MATH_H
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Elementary functions applied in place to arrays of doubles.
+ * sqrt and abs are exact in either mode. The transcendental functions in FAST mode run several
+ * arguments per instruction with polynomial approximations accurate to a few ulp, falling back
+ * to the standard library for arguments outside of their range (huge, non-finite or
+ * subnormal). PRECISE mode calls the standard library for every argument.
+ */
+namespace vector_math {
+    enum class Accuracy : std::uint8_t {
+        PRECISE, FAST
+    };
+
+    void sin(double* values, std::size_t count, Accuracy accuracy);
+
+    void cos(double* values, std::size_t count, Accuracy accuracy);
+
+    void tan(double* values, std::size_t count, Accuracy accuracy);
+
+    void exp(double* values, std::size_t count, Accuracy accuracy);
+
+    void log(double* values, std::size_t count, Accuracy accuracy);
+
+    void sqrt(double* values, std::size_t count);
+
+    void abs(double* values, std::size_t count);
+}
+
+#endif //VECTOR_MATH_H
@@ -0,0 +1,173 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+    /**
+     * The pool and the queue of the worker running on this thread
+     */
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local unsigned currentQueue = 0;
+}
+
+/**
+ * Calls of a parallelFor. Indices are claimed one by one by the caller and by the helper tasks
+ * it submitted, so a helper started after all of them were claimed does nothing.
+ */
+struct ThreadPool::Batch {
+    const std::function<void(size_t)>& body;
+    const size_t count;
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> finished = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr failure;
+
+    Batch(const std::function<void(size_t)>& body, const size_t count): body(body),
+                                                                         count(count) { }
+};
+
+ThreadPool::ThreadPool(unsigned threadsCount) {
+    if (threadsCount == 0) {
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threadsCount; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threadsCount; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(stateMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    const unsigned queue = currentPool == this
+                               ? currentQueue
+                               : nextQueue++ % static_cast<unsigned>(queues.size());
+    {
+        std::lock_guard lock(stateMutex);
+        ++queued;
+        ++unfinished;
+    }
+    {
+        std::lock_guard lock(queues[queue]->mutex);
+        queues[queue]->tasks.push_back(std::move(task));
+    }
+    wakeUp.notify_one();
+}
+
+void ThreadPool::parallelFor(const size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    const auto batch = std::make_shared<Batch>(body, count);
+    const size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([batch] {
+            runBatch(*batch);
+        });
+    }
+    runBatch(*batch);
+    std::unique_lock lock(batch->mutex);
+    batch->done.wait(lock, [&batch] {
+        return batch->finished == batch->count;
+    });
+    if (batch->failure) {
+        std::rethrow_exception(batch->failure);
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock lock(stateMutex);
+    idle.wait(lock, [this] {
+        return unfinished == 0;
+    });
+}
+
+unsigned ThreadPool::threadsCount() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+/**
+ * Runs the newest task of the own queue or the oldest task of another one
+ * @return whether a task was run
+ */
+bool ThreadPool::tryRun(const unsigned self) {
+    std::function<void()> task;
+    for (size_t i = 0; i < queues.size() && !task; ++i) {
+        Queue& queue = *queues[(self + i) % queues.size()];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    {
+        std::lock_guard lock(stateMutex);
+        --queued;
+    }
+    task();
+    std::lock_guard lock(stateMutex);
+    if (--unfinished == 0) {
+        idle.notify_all();
+    }
+    return true;
+}
+
+/**
+ * A task is counted as queued just before it is pushed, so a worker may briefly find the queues
+ * empty while the count is positive and has to retry
+ */
+void ThreadPool::work(const unsigned self) {
+    currentPool = this;
+    currentQueue = self;
+    while (true) {
+        if (tryRun(self)) {
+            continue;
+        }
+        std::unique_lock lock(stateMutex);
+        wakeUp.wait(lock, [this] {
+            return stopping || queued != 0;
+        });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::runBatch(Batch& batch) {
+    for (size_t i = batch.next++; i < batch.count; i = batch.next++) {
+        try {
+            batch.body(i);
+        } catch (...) {
+            std::lock_guard lock(batch.mutex);
+            if (!batch.failure) {
+                batch.failure = std::current_exception();
+            }
+        }
+        if (++batch.finished == batch.count) {
+            std::lock_guard lock(batch.mutex);
+            batch.done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads, each with its own queue of tasks. A worker runs the newest
+ * task of its own queue and, when that is empty, steals the oldest task of another queue.
+ * Tasks submitted by a worker go to its own queue, others are distributed round-robin.
+ */
+class ThreadPool {
+    public:
+        /**
+         * @brief Starts the workers
+         * @param threadsCount number of worker threads, 0 for one per hardware thread
+         */
+        explicit ThreadPool(unsigned threadsCount = 0);
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Runs the remaining tasks and stops the workers
+         */
+        ~ThreadPool();
+
+        /**
+         * @brief Queues a task to run in the background
+         * @param task task to run
+         */
+        void submit(std::function<void()> task);
+
+        /**
+         * @brief Calls body(0), ..., body(count - 1) in parallel and returns when all of them
+         * have finished. The calling thread takes part in the work, so this may be called from a
+         * task of the pool as well.
+         * @param count number of calls
+         * @param body function called with the index of each call
+         * @throws the first exception thrown by body, after all the calls have finished
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+        /**
+         * @brief Blocks until every submitted task has finished
+         */
+        void wait();
+
+        unsigned threadsCount() const;
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()> > tasks;
+        };
+
+        struct Batch;
+
+        std::vector<std::unique_ptr<Queue> > queues;
+        std::vector<std::thread> workers;
+        std::mutex stateMutex;
+        std::condition_variable wakeUp;
+        std::condition_variable idle;
+        /**
+         * Submitted tasks not taken by a worker yet, and ones that have not finished yet
+         */
+        size_t queued = 0;
+        size_t unfinished = 0;
+        bool stopping = false;
+        std::atomic<unsigned> nextQueue = 0;
+
+        bool tryRun(unsigned self);
+
+        void work(unsigned self);
+
+        static void runBatch(Batch& batch);
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,81 @@
+#include "decimation.h"
+
+#include <algorithm>
+#include <cmath>
+
+PixelDecimator::PixelDecimator(const plotter2d::Options::ApproximationMode mode,
+                               sf::Vertex* output): mode(mode), output(output) { }
+
+void PixelDecimator::restart(sf::Vertex* output) {
+    this->output = output;
+    count = 0;
+    columnOpen = false;
+    index = 0;
+    rows.clear();
+}
+
+void PixelDecimator::add(const sf::Vertex& vertex) {
+    const auto vertexColumn = static_cast<long>(std::floor(vertex.position.x));
+    if (mode == plotter2d::Options::POINTS) {
+        if (!columnOpen || vertexColumn != column) {
+            columnOpen = true;
+            column = vertexColumn;
+            rows.clear();
+        }
+        const auto row = static_cast<long>(std::floor(vertex.position.y));
+        if (std::find(rows.begin(), rows.end(), row) == rows.end()) {
+            rows.push_back(row);
+            emit(vertex);
+        }
+        return;
+    }
+    if (!columnOpen || vertexColumn != column) {
+        closeColumn();
+        columnOpen = true;
+        column = vertexColumn;
+        first = lowest = highest = vertex;
+        firstIndex = lowestIndex = highestIndex = index;
+    } else if (vertex.position.y < lowest.position.y) {
+        lowest = vertex;
+        lowestIndex = index;
+    } else if (vertex.position.y > highest.position.y) {
+        highest = vertex;
+        highestIndex = index;
+    }
+    last = vertex;
+    lastIndex = index++;
+}
+
+size_t PixelDecimator::finish() {
+    closeColumn();
+    return count;
+}
+
+void PixelDecimator::emit(const sf::Vertex& vertex) {
+    output[count++] = vertex;
+}
+
+void PixelDecimator::closeColumn() {
+    if (!columnOpen || mode == plotter2d::Options::POINTS) {
+        return;
+    }
+    columnOpen = false;
+    emit(first);
+    const bool lowestFirst = lowestIndex < highestIndex;
+    const size_t middleIndices[2] = {
+        lowestFirst ? lowestIndex : highestIndex, lowestFirst ? highestIndex : lowestIndex
+    };
+    const sf::Vertex* middle[2] = {
+        lowestFirst ? &lowest : &highest, lowestFirst ? &highest : &lowest
+    };
+    size_t previousIndex = firstIndex;
+    for (int i = 0; i < 2; ++i) {
+        if (middleIndices[i] != previousIndex && middleIndices[i] != lastIndex) {
+            emit(*middle[i]);
+            previousIndex = middleIndices[i];
+        }
+    }
+    if (lastIndex != previousIndex) {
+        emit(last);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DECIMATION_H
+#define DECIMATION_H
+
+#include <cstddef>
+#include <vector>
+#include <SFML/Graphics/Vertex.hpp>
+
+#include "interface/plotter2d.h"
+
+/**
+ * Reduces the vertices of a function, given in increasing order of their x, to the ones that
+ * make a difference on screen. In the LINES mode each pixel column keeps its first, lowest,
+ * highest and last vertex, in their original order (M4 decimation): the line strip through them
+ * covers the same pixels of the column as the one through all of them, and joins the
+ * neighbouring columns at the same points. In the POINTS mode one vertex per pixel is kept.
+ * The number of the vertices kept is thus bound by the width of the plot instead of its
+ * resolution.
+ */
+class PixelDecimator {
+    plotter2d::Options::ApproximationMode mode;
+    sf::Vertex* output;
+    size_t count = 0;
+    /**
+     * Vertices of the current column and their indices in the input, used to skip duplicates
+     */
+    bool columnOpen = false;
+    long column = 0;
+    size_t index = 0;
+    sf::Vertex first;
+    sf::Vertex lowest;
+    sf::Vertex highest;
+    sf::Vertex last;
+    size_t firstIndex = 0;
+    size_t lowestIndex = 0;
+    size_t highestIndex = 0;
+    size_t lastIndex = 0;
+    /**
+     * Rows of the current column with a vertex already kept, in the POINTS mode
+     */
+    std::vector<long> rows;
+
+    void emit(const sf::Vertex& vertex);
+
+    void closeColumn();
+
+    public:
+        /**
+         * @brief Constructs a decimator writing the kept vertices to the output
+         * @param mode approximation mode the vertices are drawn in
+         * @param output array able to hold all the vertices added
+         */
+        PixelDecimator(plotter2d::Options::ApproximationMode mode, sf::Vertex* output);
+
+        /**
+         * @brief Starts over writing to another output, keeping the memory of the decimator
+         */
+        void restart(sf::Vertex* output);
+
+        /**
+         * @brief Adds the next vertex, in screen coordinates
+         */
+        void add(const sf::Vertex& vertex);
+
+        /**
+         * @brief Writes the vertices of the last column
+         * @return number of the vertices written to the output
+         */
+        size_t finish();
+};
+
+#endif //DECIMATION_H
@@ -0,0 +1,54 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * A bounded lock-free queue passing values from one producer thread to one consumer thread.
+ * The producer stores a value in its slot before publishing it by advancing the tail, the
+ * consumer reads it before freeing the slot by advancing the head; each index is written by one
+ * side only, so neither side ever waits for the other.
+ */
+template<typename T, std::size_t CAPACITY>
+class SpscQueue {
+    /**
+     * Counts of the values popped and pushed, only growing; the slot of a value is its index
+     * modulo the capacity. They lie on separate cache lines, being written by different threads.
+     */
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) T slots_[CAPACITY]{};
+
+    public:
+        /**
+         * @brief Appends a value, to be called by the producer thread only
+         * @return whether the value was appended, false if the queue is full
+         */
+        bool push(const T& value) {
+            const std::size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == CAPACITY) {
+                return false;
+            }
+            slots_[tail % CAPACITY] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Removes the oldest value, to be called by the consumer thread only
+         * @param value set to the removed value
+         * @return whether a value was removed, false if the queue is empty
+         */
+        bool pop(T& value) {
+            const std::size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = slots_[head % CAPACITY];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+};
+
+#endif //SPSC_QUEUE_H
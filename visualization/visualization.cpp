@@ -1,7 +1,10 @@
 #include "visualization.h"
+#include "decimation.h"
+#include "interface/allocation_counter.h"
 
+#include <algorithm>
 #include <cmath>
-#include <iomanip>
+#include <cstdio>
 #include <iostream>
 #include <optional>
 #include <SFML/Graphics.hpp>
@@ -15,19 +18,45 @@ static constexpr unsigned BUTTON_HEIGHT = 30;
 static constexpr unsigned BUTTON_PADDING = 10;
 static constexpr double PAN_FACTOR = 0.15;
 static constexpr unsigned GRID_SIZE = 10;
+/**
+ * Fraction of the visible width evaluated and drawn beyond each side of the view, so that panning
+ * within it only moves the graph
+ */
+static constexpr double GRAPH_MARGIN = 0.5;
+/**
+ * Factor by which the view may be zoomed in or out before the graph is rebuilt; the graph is
+ * decimated at as many columns per pixel, so that zooming in keeps its detail
+ */
+static constexpr double GRAPH_ZOOM_LIMIT = 2;
+/**
+ * Interval at which the UI thread checks for a graph in progress, handling the events meanwhile,
+ * and the evaluation thread for a free graph to build
+ */
+static constexpr std::chrono::milliseconds GRAPH_POLL_INTERVAL(5);
 
 Visualizer::Visualizer(const std::vector<const ParsedFunction*>& functions, const double xMin,
                        const double xMax,
                        const plotter2d::Options& options) : showCoordinates(false),
                                                             clickedPoint(0, 0), config(options),
-                                                            evaluator(functions, true),
-                                                            plotData(nullptr), zoomFactor(1.0),
+                                                            evaluator(functions, true,
+                                                                      options.threadsCount,
+                                                                      options.singlePrecision),
+                                                            zoomFactor(1.0),
                                                             xMin_(xMin), xMax_(xMax),
                                                             pointsCount_(options.resolution),
                                                             yMin_(0), yMax_(0), rescaleY_(true),
                                                             useCustomPlotRange_(
                                                                 options.useCustomPlotRange),
-                                                            plotRange_(options.plotRange) {
+                                                            plotRange_(options.plotRange),
+                                                            dirty_(VIEW_DIRTY | UI_DIRTY),
+                                                            graphDecimator_(
+                                                                options.approximationMode,
+                                                                nullptr),
+                                                            requestedView_(0, 0, Point(0, 0)) {
+    evaluator.setTileCacheBudget(options.tileCacheBudget);
+    for (GraphFrame& graph : graphFrames_) {
+        freeGraphs_.push(&graph);
+    }
     if (!font.loadFromFile("lato.ttf")) {
         std::cerr << "Warning: Failed to load font for buttons" << std::endl;
     }
@@ -133,6 +162,7 @@ void Visualizer::initializeButtons(const sf::Vector2u& windowSize) {
     });
     rescaleButton.setAction([this] {
         rescaleY_ = true;
+        dirty_ |= VIEW_DIRTY;
     });
     if (derivativeButton) {
         (*derivativeButton)->setAction([this] {
@@ -201,37 +231,98 @@ sf::Vector2f Visualizer::scalePoint(const Point& p, const unsigned effectiveSize
     return {static_cast<float>(x), static_cast<float>(y)};
 }
 
-sf::Vertex* Visualizer::renderGraph(const sf::Vector2u& windowSize) const {
+/**
+ * The translation is computed in double precision from the corner of the view the vertices were
+ * built for, so the vertices stay small numbers however far the plot is panned or zoomed; the
+ * graph is rebuilt relative to the new view once it leaves them
+ */
+sf::Transform Visualizer::calculateGraphTransform(const sf::Vector2u& windowSize,
+                                                  const Rectangle& graphView) const {
     const unsigned offset[2] = {
         static_cast<unsigned>(windowSize.x * PADDING_SIZE[0]),
         static_cast<unsigned>(windowSize.y * PADDING_SIZE[1])
     };
     const unsigned effectiveSize[2] = {windowSize.x - 2 * offset[0], windowSize.y - 2 * offset[1]};
-    auto* line = new sf::Vertex[plotData->pointsCount()];
-
-    validPointCount_ = 0;
+    const double scale[2] = {
+        effectiveSize[0] / (xMax_ - xMin_), effectiveSize[1] / (yMax_ - yMin_)
+    };
+    const double translation[2] = {
+        offset[0] + (graphView.anchor().x() - xMin_) * scale[0],
+        offset[1] + effectiveSize[1] - (graphView.anchor().y() - yMin_) * scale[1]
+    };
+    const double unit[2] = {
+        graphView.width() / (effectiveSize[0] * GRAPH_ZOOM_LIMIT) * scale[0],
+        graphView.height() / (effectiveSize[1] * GRAPH_ZOOM_LIMIT) * scale[1]
+    };
+    return {
+        static_cast<float>(unit[0]), 0, static_cast<float>(translation[0]),
+        0, static_cast<float>(-unit[1]), static_cast<float>(translation[1]),
+        0, 0, 1
+    };
+}
 
-    for (int i = 0; i < plotData->pointsCount(); ++i) {
-        const Point& p = plotData->points()[i];
-        if (useCustomPlotRange_ && (p.y() < plotRange_.first || p.y() > plotRange_.second)) {
-            continue;
+/**
+ * Each series is streamed once, a block of samples at a time: the block is filtered by the plot
+ * range and mapped to the coordinates of the vertices in a vectorized pass, while its values are
+ * in the cache, and its kept samples go straight to the decimator
+ */
+void Visualizer::renderGraph(const sf::Vector2u& windowSize, GraphFrame& graph) {
+    const unsigned offset[2] = {
+        static_cast<unsigned>(windowSize.x * PADDING_SIZE[0]),
+        static_cast<unsigned>(windowSize.y * PADDING_SIZE[1])
+    };
+    const unsigned effectiveSize[2] = {windowSize.x - 2 * offset[0], windowSize.y - 2 * offset[1]};
+    const SampleSeries::Mapping mapping{
+        {graph.view.anchor().x(), graph.view.anchor().y()},
+        {
+            effectiveSize[0] * GRAPH_ZOOM_LIMIT / graph.view.width(),
+            effectiveSize[1] * GRAPH_ZOOM_LIMIT / graph.view.height()
+        },
+        useCustomPlotRange_ ? plotRange_.first : -INFINITY,
+        useCustomPlotRange_ ? plotRange_.second : INFINITY
+    };
+    const sf::Color color(config.graphColor);
+    graph.vertices.resize(plotData.pointsCount());
+    sf::Vertex* line = graph.vertices.data();
+
+    graph.vertexCount = 0;
+    graph.stripEnds.clear();
+    const auto endStrip = [&graph](PixelDecimator& decimator) {
+        const auto count = static_cast<int>(decimator.finish());
+        if (count > 0) {
+            graph.vertexCount += count;
+            graph.stripEnds.push_back(graph.vertexCount);
         }
-        sf::Vertex v(scalePoint(p, effectiveSize, offset));
-        v.color = sf::Color(config.graphColor);
-        line[validPointCount_++] = v;
-    }
+    };
 
-    if (validPointCount_ < plotData->pointsCount()) {
-        auto* filteredLine = new sf::Vertex[validPointCount_];
-        for (int i = 0; i < validPointCount_; ++i) {
-            filteredLine[i] = line[i];
+    SampleSeries::MappedBlock block;
+    for (size_t function = 0; function < plotData.functionsCount(); ++function) {
+        const SeriesView& series = plotData.series(function);
+        graphDecimator_.restart(line + graph.vertexCount);
+        bool started = false;
+        bool gapPending = false;
+        for (size_t word = series.first() / SampleSeries::ALIGNMENT;
+             word * SampleSeries::ALIGNMENT < series.last(); ++word) {
+            series.samples().mapBlock(word, series.first(), series.last(), mapping, block);
+            std::uint64_t gaps = block.gaps;
+            for (std::uint64_t kept = block.kept; kept != 0; kept &= kept - 1) {
+                const int i = __builtin_ctzll(kept);
+                const std::uint64_t preceding = (std::uint64_t{1} << i) - 1;
+                if (started && (gapPending || (gaps & preceding) != 0)) {
+                    endStrip(graphDecimator_);
+                    graphDecimator_.restart(line + graph.vertexCount);
+                }
+                gaps &= ~preceding;
+                started = true;
+                gapPending = false;
+                graphDecimator_.add(sf::Vertex(sf::Vector2f(static_cast<float>(block.xs[i]),
+                                                            static_cast<float>(block.ys[i])),
+                                               color));
+            }
+            gapPending = gapPending || gaps != 0;
         }
-        delete[] line;
-
-        return filteredLine;
+        endStrip(graphDecimator_);
     }
-
-    return line;
 }
 
 double Visualizer::calculateAxisPosition(const double min, const double max) {
@@ -244,20 +335,20 @@ double Visualizer::calculateAxisPosition(const double min, const double max) {
     return max;
 }
 
-std::vector<sf::Vertex> Visualizer::renderGrid(const sf::Vector2u& windowSize) const {
+void Visualizer::renderGrid(const sf::Vector2u& windowSize, std::vector<sf::Vertex>& grid) const {
     const unsigned offset[2] = {
         static_cast<unsigned>(windowSize.x * PADDING_SIZE[0]),
         static_cast<unsigned>(windowSize.y * PADDING_SIZE[1])
     };
     const unsigned effectiveSize[2] = {windowSize.x - 2 * offset[0], windowSize.y - 2 * offset[1]};
-    std::vector<sf::Vector2f> grid;
-    grid.reserve(GRID_SIZE * 4);
+    const sf::Color color(0xAAAAAAFF);
+    grid.clear();
     const double xStep = (xMax_ - xMin_) / (GRID_SIZE);
     const double xAxis = calculateAxisPosition(xMin_, xMax_);
     for (int i = 1; i <= GRID_SIZE; ++i) {
         const double x = xAxis == xMax_ ? xAxis - i * xStep : xAxis + i * xStep;
-        grid.emplace_back(scalePoint(Point(x, yMin_), effectiveSize, offset));
-        grid.emplace_back(scalePoint(Point(x, yMax_), effectiveSize, offset));
+        grid.emplace_back(scalePoint(Point(x, yMin_), effectiveSize, offset), color);
+        grid.emplace_back(scalePoint(Point(x, yMax_), effectiveSize, offset), color);
     }
     for (int i = 1; i <= GRID_SIZE; ++i) {
         const double x = xAxis == 0.
@@ -265,15 +356,15 @@ std::vector<sf::Vertex> Visualizer::renderGrid(const sf::Vector2u& windowSize) c
                              : xAxis == xMin_
                                    ? xAxis + (GRID_SIZE + i) * xStep
                                    : xAxis - (GRID_SIZE + i) * xStep;
-        grid.emplace_back(scalePoint(Point(x, yMin_), effectiveSize, offset));
-        grid.emplace_back(scalePoint(Point(x, yMax_), effectiveSize, offset));
+        grid.emplace_back(scalePoint(Point(x, yMin_), effectiveSize, offset), color);
+        grid.emplace_back(scalePoint(Point(x, yMax_), effectiveSize, offset), color);
     }
     const double yStep = (yMax_ - yMin_) / (GRID_SIZE);
     const double yAxis = calculateAxisPosition(yMin_, yMax_);
     for (int i = 1; i <= GRID_SIZE; ++i) {
         const double y = yAxis == yMax_ ? yAxis - i * yStep : yAxis + i * yStep;
-        grid.emplace_back(scalePoint(Point(xMin_, y), effectiveSize, offset));
-        grid.emplace_back(scalePoint(Point(xMax_, y), effectiveSize, offset));
+        grid.emplace_back(scalePoint(Point(xMin_, y), effectiveSize, offset), color);
+        grid.emplace_back(scalePoint(Point(xMax_, y), effectiveSize, offset), color);
     }
     for (int i = 1; i <= GRID_SIZE; ++i) {
         const double y = yAxis == 0.
@@ -281,19 +372,12 @@ std::vector<sf::Vertex> Visualizer::renderGrid(const sf::Vector2u& windowSize) c
                              : yAxis == yMin_
                                    ? yAxis + (GRID_SIZE + i) * yStep
                                    : yAxis - (GRID_SIZE + i) * yStep;
-        grid.emplace_back(scalePoint(Point(xMin_, y), effectiveSize, offset));
-        grid.emplace_back(scalePoint(Point(xMax_, y), effectiveSize, offset));
+        grid.emplace_back(scalePoint(Point(xMin_, y), effectiveSize, offset), color);
+        grid.emplace_back(scalePoint(Point(xMax_, y), effectiveSize, offset), color);
     }
-    std::vector<sf::Vertex> result;
-    result.reserve(grid.size());
-    std::transform(grid.begin(), grid.end(), std::back_inserter(result),
-                   [](const sf::Vector2f& pos) {
-                       return sf::Vertex(pos, sf::Color(0xAAAAAAFF));
-                   });
-    return result;
 }
 
-std::vector<sf::Vertex> Visualizer::renderAxes(const sf::Vector2u& windowSize) const {
+void Visualizer::renderAxes(const sf::Vector2u& windowSize, std::vector<sf::Vertex>& axes) const {
     const unsigned offset[2] = {
         static_cast<unsigned>(windowSize.x * PADDING_SIZE[0]),
         static_cast<unsigned>(windowSize.y * PADDING_SIZE[1])
@@ -301,31 +385,27 @@ std::vector<sf::Vertex> Visualizer::renderAxes(const sf::Vector2u& windowSize) c
     const unsigned effectiveSize[2] = {windowSize.x - 2 * offset[0], windowSize.y - 2 * offset[1]};
     const double xAxisPosY = calculateAxisPosition(yMin_, yMax_);
     const double yAxisPosX = calculateAxisPosition(xMin_, xMax_);
-    std::vector<sf::Vector2f> vectors;
-    vectors.push_back(scalePoint(Point(xMin_, xAxisPosY), effectiveSize, offset));
-    vectors.push_back(scalePoint(Point(xMax_, xAxisPosY), effectiveSize, offset));
-    vectors.push_back(scalePoint(Point(yAxisPosX, yMin_), effectiveSize, offset));
-    vectors.push_back(scalePoint(Point(yAxisPosX, yMax_), effectiveSize, offset));
-    vectors.emplace_back(vectors[1]);
-    vectors.emplace_back(vectors[1].x - effectiveSize[0] * 0.01,
-                         vectors[1].y + effectiveSize[1] * 0.005);
-    vectors.emplace_back(vectors[1]);
-    vectors.emplace_back(vectors[1].x - effectiveSize[0] * 0.01,
-                         vectors[1].y - effectiveSize[1] * 0.005);
-    vectors.emplace_back(vectors[3]);
-    vectors.emplace_back(vectors[3].x - effectiveSize[0] * 0.005,
-                         vectors[3].y + effectiveSize[1] * 0.01);
-    vectors.emplace_back(vectors[3]);
-    vectors.emplace_back(vectors[3].x + effectiveSize[0] * 0.005,
-                         vectors[3].y + effectiveSize[1] * 0.01);
-
-    std::vector<sf::Vertex> result;
-    result.reserve(vectors.size());
-    std::transform(vectors.begin(), vectors.end(), std::back_inserter(result),
-                   [](const sf::Vector2f& pos) {
-                       return sf::Vertex(pos, sf::Color::Black);
-                   });
-    return result;
+    const sf::Vector2f xAxisEnd = scalePoint(Point(xMax_, xAxisPosY), effectiveSize, offset);
+    const sf::Vector2f yAxisEnd = scalePoint(Point(yAxisPosX, yMax_), effectiveSize, offset);
+    const float arrowLength[2] = {effectiveSize[0] * 0.01f, effectiveSize[1] * 0.01f};
+    const sf::Vector2f vectors[] = {
+        scalePoint(Point(xMin_, xAxisPosY), effectiveSize, offset),
+        xAxisEnd,
+        scalePoint(Point(yAxisPosX, yMin_), effectiveSize, offset),
+        yAxisEnd,
+        xAxisEnd,
+        {xAxisEnd.x - arrowLength[0], xAxisEnd.y + arrowLength[1] / 2},
+        xAxisEnd,
+        {xAxisEnd.x - arrowLength[0], xAxisEnd.y - arrowLength[1] / 2},
+        yAxisEnd,
+        {yAxisEnd.x - arrowLength[0] / 2, yAxisEnd.y + arrowLength[1]},
+        yAxisEnd,
+        {yAxisEnd.x + arrowLength[0] / 2, yAxisEnd.y + arrowLength[1]}
+    };
+    axes.clear();
+    for (const sf::Vector2f& position : vectors) {
+        axes.emplace_back(position, sf::Color::Black);
+    }
 }
 
 void Visualizer::drawUI(sf::RenderWindow& window) {
@@ -343,18 +423,22 @@ void Visualizer::drawUI(sf::RenderWindow& window) {
 }
 
 
-bool Visualizer::doublesSignificantlyDiffer(const double a, const double b) const {
-    return std::abs(a - b) >= (xMax_ - xMin_) / (pointsCount_ - 1);
-}
-
-bool Visualizer::shouldReevaluatePlotData() const {
-    if (plotData == nullptr || rescaleY_) {
+bool Visualizer::shouldRequestGraph() const {
+    if (rescaleY_ || requestedGeneration_ == 0) {
         return true;
     }
-    const Rectangle& domain = plotData->domain();
-    const double xAnchor = domain.anchor().x();
-    return doublesSignificantlyDiffer(xAnchor, xMin_) || doublesSignificantlyDiffer(
-               xAnchor + domain.width(), xMax_);
+    if (xMin_ < requestedRange_.first || xMax_ > requestedRange_.second) {
+        return true;
+    }
+    const double zoom[2] = {
+        (xMax_ - xMin_) / requestedView_.width(), (yMax_ - yMin_) / requestedView_.height()
+    };
+    for (const double factor : zoom) {
+        if (!(1 / GRAPH_ZOOM_LIMIT <= factor && factor <= GRAPH_ZOOM_LIMIT)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void Visualizer::panLeft() {
@@ -362,6 +446,7 @@ void Visualizer::panLeft() {
     double panAmount = domainWidth * PAN_FACTOR;
     xMin_ -= panAmount;
     xMax_ -= panAmount;
+    dirty_ |= VIEW_DIRTY;
 }
 
 void Visualizer::panRight() {
@@ -369,31 +454,174 @@ void Visualizer::panRight() {
     double panAmount = domainWidth * PAN_FACTOR;
     xMin_ += panAmount;
     xMax_ += panAmount;
+    dirty_ |= VIEW_DIRTY;
 }
 
-void Visualizer::updatePlotData() {
-    delete plotData;
+void Visualizer::buildGraph(const GraphRequest& request, GraphFrame& graph) {
+    const size_t allocations = plotter2d::allocationCount();
+    for (unsigned i = 0; i < request.derivatives; ++i) {
+        evaluator.pushFunction(
+            FunctionEvaluator::computeDerivative(evaluator.parsedFunctions().back(),
+                                                 -request.view.width() / pointsCount_));
+    }
+    const double height = useCustomPlotRange_ && request.rescale
+                              ? plotRange_.second - plotRange_.first
+                              : request.view.height();
+    const double pixelHeight = height / (ABSOLUTE_WINDOW_SIZE * (1 - 2 * PADDING_SIZE[1]));
+    if (useCustomPlotRange_) {
+        evaluator.setVisibleRange(plotRange_.first, plotRange_.second, pixelHeight / 2);
+    }
+    if (config.adaptiveSampling && pixelHeight > 0) {
+        evaluator.setAdaptiveSampling(pixelHeight / 2);
+    }
 
-    plotData = evaluator.evaluate(xMin_, xMax_, pointsCount_);
+    const auto graphPointsCount = static_cast<unsigned>(
+        std::lround((pointsCount_ - 1) * (1 + 2 * GRAPH_MARGIN))) + 1;
+    evaluator.evaluate(request.range.first, request.range.second, graphPointsCount, plotData);
 
-    if (rescaleY_) {
-        std::cout << std::flush;
-        const Rectangle& domain = plotData->domain();
+    graph.view = request.view;
+    graph.rescaled = request.rescale;
+    graph.generation = request.generation;
+    if (request.rescale) {
+        const double xMin = request.view.anchor().x();
+        const double xMax = xMin + request.view.width();
         if (useCustomPlotRange_) {
-            yMin_ = plotRange_.first;
-            yMax_ = plotRange_.second;
+            graph.view = Rectangle(Point(xMin, plotRange_.first), Point(xMax, plotRange_.second));
         } else {
-            yMin_ = domain.anchor().y();
-            yMax_ = domain.anchor().y() + domain.height();
+            // served from the samples just evaluated, on the same grid
+            PlotData visibleData;
+            evaluator.evaluate(xMin, xMax, pointsCount_, visibleData);
+            const Rectangle& domain = visibleData.domain();
+            graph.view = Rectangle(request.view.width(), domain.height(),
+                                   Point(xMin, domain.anchor().y()));
+        }
+    }
+    renderGraph({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE}, graph);
+    graph.allocations = plotter2d::allocationCount() - allocations;
+}
+
+/**
+ * Requests posted while a graph is being built are coalesced, so that only the newest one is
+ * built next; a graph is built only once the UI thread has freed one to build it in
+ */
+void Visualizer::produceGraphs() {
+    std::uint64_t built = 0;
+    try {
+        while (true) {
+            GraphRequest request;
+            {
+                std::unique_lock lock(requestMutex_);
+                requestPosted_.wait(lock, [this, built] {
+                    return stopping_ || request_.generation != built;
+                });
+                if (stopping_) {
+                    return;
+                }
+                request = request_;
+                request_.rescale = false;
+                request_.derivatives = 0;
+            }
+            built = request.generation;
+            GraphFrame* graph = nullptr;
+            while (!freeGraphs_.pop(graph)) {
+                if (stopping_) {
+                    return;
+                }
+                std::this_thread::sleep_for(GRAPH_POLL_INTERVAL);
+            }
+            buildGraph(request, *graph);
+            readyGraphs_.push(graph);
         }
-        rescaleY_ = false;
+    } catch (...) {
+        graphFailure_ = std::current_exception();
+        graphFailed_ = true;
+    }
+}
+
+void Visualizer::requestGraph() {
+    const double margin = (xMax_ - xMin_) * GRAPH_MARGIN;
+    requestedRange_ = {xMin_ - margin, xMax_ + margin};
+    requestedView_ = Rectangle(xMax_ - xMin_, yMax_ - yMin_, Point(xMin_, yMin_));
+    {
+        std::lock_guard lock(requestMutex_);
+        request_.view = requestedView_;
+        request_.range = requestedRange_;
+        request_.rescale = request_.rescale || rescaleY_;
+        request_.generation = ++requestedGeneration_;
+    }
+    requestPosted_.notify_one();
+    rescaleY_ = false;
+}
+
+/**
+ * A rescaled graph brings the range of y fitted to its samples, which the view takes over
+ */
+bool Visualizer::receiveGraphs() {
+    if (graphFailed_) {
+        stopGraphThread();
+        std::rethrow_exception(graphFailure_);
+    }
+    bool received = false;
+    GraphFrame* graph = nullptr;
+    while (readyGraphs_.pop(graph)) {
+        if (shownGraph_) {
+            freeGraphs_.push(shownGraph_);
+        }
+        shownGraph_ = graph;
+        if (graph->rescaled) {
+            yMin_ = graph->view.anchor().y();
+            yMax_ = graph->view.anchor().y() + graph->view.height();
+        }
+        if (graph->generation == requestedGeneration_) {
+            requestedView_ = graph->view;
+        }
+        frameStatistics_.lastGraphAllocations = graph->allocations;
+        received = true;
+    }
+    return received;
+}
+
+bool Visualizer::graphPending() const {
+    return shownGraph_ == nullptr || shownGraph_->generation != requestedGeneration_;
+}
+
+void Visualizer::stopGraphThread() {
+    {
+        std::lock_guard lock(requestMutex_);
+        stopping_ = true;
+    }
+    requestPosted_.notify_one();
+    if (graphThread_.joinable()) {
+        graphThread_.join();
     }
 }
 
-void Visualizer::drawGraph(sf::RenderWindow& window, const sf::Vertex* lines) const {
-    window.draw(lines, validPointCount_, config.approximationMode == plotter2d::Options::POINTS
-                                             ? sf::Points
-                                             : sf::LineStrip);
+void Visualizer::drawGraph(sf::RenderWindow& window, const GraphFrame& graph) const {
+    const sf::Vertex* lines = graph.vertices.data();
+    const sf::Vector2u windowSize(ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE);
+    const float offset[2] = {
+        static_cast<float>(static_cast<unsigned>(windowSize.x * PADDING_SIZE[0])),
+        static_cast<float>(static_cast<unsigned>(windowSize.y * PADDING_SIZE[1]))
+    };
+    const sf::FloatRect plotArea(offset[0], offset[1], windowSize.x - 2 * offset[0],
+                                 windowSize.y - 2 * offset[1]);
+    // the graph extends beyond the view by its margin, which is clipped by the viewport
+    sf::View plotView(plotArea);
+    plotView.setViewport(sf::FloatRect(plotArea.left / windowSize.x, plotArea.top / windowSize.y,
+                                       plotArea.width / windowSize.x,
+                                       plotArea.height / windowSize.y));
+    window.setView(plotView);
+    const sf::RenderStates states(graphTransform_);
+    if (config.approximationMode == plotter2d::Options::POINTS) {
+        window.draw(lines, graph.vertexCount, sf::Points, states);
+    } else {
+        int stripStart = 0;
+        for (const int stripEnd : graph.stripEnds) {
+            window.draw(lines + stripStart, stripEnd - stripStart, sf::LineStrip, states);
+            stripStart = stripEnd;
+        }
+    }
+    window.setView(window.getDefaultView());
 }
 
 void Visualizer::drawVertices(sf::RenderWindow& window, const std::vector<sf::Vertex>& axes) {
@@ -407,6 +635,7 @@ void Visualizer::zoomIn() {
     xMax_ -= 0.5 * xGrowth;
     yMin_ += 0.5 * yGrowth;
     yMax_ -= 0.5 * yGrowth;
+    dirty_ |= VIEW_DIRTY;
 }
 
 void Visualizer::zoomOut() {
@@ -416,13 +645,15 @@ void Visualizer::zoomOut() {
     xMax_ += 0.5 * growth;
     yMin_ -= 0.5 * yGrowth;
     yMax_ += 0.5 * yGrowth;
+    dirty_ |= VIEW_DIRTY;
 }
 
 void Visualizer::addDerivative() {
-    evaluator.pushFunction(
-        FunctionEvaluator::computeDerivative(evaluator.parsedFunctions().back(),
-                                             (xMin_ - xMax_) / pointsCount_));
-    updatePlotData();
+    {
+        std::lock_guard lock(requestMutex_);
+        ++request_.derivatives;
+    }
+    requestGraph();
 }
 
 sf::Vector2f scaleMousePositionToAbsolute(int x, int y, sf::Vector2u windowSize) {
@@ -434,97 +665,159 @@ sf::Vector2f scaleMousePositionToAbsolute(int x, int y, sf::Vector2u windowSize)
     };
 }
 
+void Visualizer::handleEvent(sf::RenderWindow& window, const sf::Event& event) {
+    if (event.type == sf::Event::Closed) {
+        window.close();
+    } else if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus) {
+        dirty_ |= UI_DIRTY;
+    } else if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button ==
+               sf::Mouse::Left) {
+        const auto mousePos = scaleMousePositionToAbsolute(
+            event.mouseButton.x, event.mouseButton.y, window.getSize());
+
+        bool buttonClicked = false;
+        if (config.drawUi) {
+            auto triggered = std::find_if(buttons.cbegin(), buttons.cend(),
+                                          [&mousePos](auto& entry) {
+                                              return isMouseInButton(
+                                                  mousePos, entry.second.rectangle());
+                                          });
+            if (triggered != buttons.cend()) {
+                std::cout << "Button " << triggered->first << " triggered\n";
+                triggered->second.trigger();
+                buttonClicked = true;
+            }
+        }
+
+        if (!buttonClicked) {
+            Point worldPoint = screenToWorldCoordinates(mousePos, {
+                                                            ABSOLUTE_WINDOW_SIZE,
+                                                            ABSOLUTE_WINDOW_SIZE
+                                                        });
+
+            if (!std::isnan(worldPoint.x()) && !std::isnan(worldPoint.y())) {
+                clickedPoint = worldPoint;
+                showCoordinates = true;
+
+                if (!font.getInfo().family.empty()) {
+                    char coordinates[64];
+                    std::snprintf(coordinates, sizeof(coordinates), "(%.3f, %.3f)",
+                                  clickedPoint.x(), clickedPoint.y());
+                    coordinateText.setString(coordinates);
+
+                    sf::FloatRect textBounds = coordinateText.getLocalBounds();
+                    constexpr float padding = 6.0f;
+
+                    coordinateFrame.setSize(sf::Vector2f(
+                        textBounds.width + 2 * padding, textBounds.height + 2 * padding));
+                    coordinateFrame.setPosition(10, 10);
+
+                    coordinateText.setPosition(coordinateFrame.getPosition().x + padding,
+                                               coordinateFrame.getPosition().y + padding -
+                                               textBounds.top);
+                }
+            } else {
+                showCoordinates = false;
+            }
+            dirty_ |= UI_DIRTY;
+        }
+    } else if (event.type == sf::Event::KeyPressed && event.key.code ==
+               sf::Keyboard::Escape) {
+        showCoordinates = false;
+        dirty_ |= UI_DIRTY;
+    }
+}
+
+void Visualizer::drawFrame(sf::RenderWindow& window) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t allocations = plotter2d::allocationCount();
+    if (dirty_ & VIEW_DIRTY && shouldRequestGraph()) {
+        requestGraph();
+    }
+    if (dirty_ & DATA_DIRTY) {
+        ++frameStatistics_.rebuilt;
+    }
+    // until the first graph arrives the range of y is unknown, so only the buttons are drawn
+    if (dirty_ & (VIEW_DIRTY | DATA_DIRTY) && shownGraph_) {
+        if (config.drawAxes) {
+            renderGrid({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE}, gridVertices_);
+            renderAxes({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE}, axesVertices_);
+        }
+        graphTransform_ = calculateGraphTransform({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE},
+                                                  shownGraph_->view);
+    }
+    dirty_ = 0;
+
+    window.clear(sf::Color::White);
+
+    if (shownGraph_) {
+        if (config.drawAxes) {
+            drawVertices(window, gridVertices_);
+            drawVertices(window, axesVertices_);
+        }
+        drawGraph(window, *shownGraph_);
+    }
+    if (config.drawUi) {
+        drawUI(window);
+    }
+
+    const auto frameTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    ++frameStatistics_.frames;
+    frameStatistics_.lastFrameTime = frameTime;
+    frameStatistics_.longestFrameTime = std::max(frameStatistics_.longestFrameTime, frameTime);
+    frameStatistics_.totalFrameTime += frameTime;
+    frameStatistics_.lastFrameAllocations = plotter2d::allocationCount() - allocations;
+    window.display();
+}
+
 void Visualizer::render() {
     sf::RenderWindow window(sf::VideoMode({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE}),
                             "Plotter2D");
+    window.setFramerateLimit(config.frameRateLimit);
     if (config.drawUi) {
         initializeButtons({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE});
     }
+    dirty_ |= UI_DIRTY;
+    stopping_ = false;
+    graphThread_ = std::thread(&Visualizer::produceGraphs, this);
     while (window.isOpen()) {
         sf::Event event{};
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
-            } else if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button ==
-                       sf::Mouse::Left) {
-                const auto mousePos = scaleMousePositionToAbsolute(
-                    event.mouseButton.x, event.mouseButton.y, window.getSize());
-
-                bool buttonClicked = false;
-                if (config.drawUi) {
-                    auto triggered = std::find_if(buttons.cbegin(), buttons.cend(),
-                                                  [&mousePos](auto& entry) {
-                                                      return isMouseInButton(
-                                                          mousePos, entry.second.rectangle());
-                                                  });
-                    if (triggered != buttons.cend()) {
-                        std::cout << "Button " << triggered->first << " triggered\n";
-                        triggered->second.trigger();
-                        buttonClicked = true;
-                    }
-                }
-
-                if (!buttonClicked) {
-                    Point worldPoint = screenToWorldCoordinates(mousePos, {
-                                                                    ABSOLUTE_WINDOW_SIZE,
-                                                                    ABSOLUTE_WINDOW_SIZE
-                                                                });
-
-                    if (!std::isnan(worldPoint.x()) && !std::isnan(worldPoint.y())) {
-                        clickedPoint = worldPoint;
-                        showCoordinates = true;
-
-                        if (!font.getInfo().family.empty()) {
-                            std::ostringstream oss;
-                            oss << std::fixed << std::setprecision(3);
-                            oss << "(" << clickedPoint.x() << ", " << clickedPoint.y() << ")";
-                            coordinateText.setString(oss.str());
-
-                            sf::FloatRect textBounds = coordinateText.getLocalBounds();
-                            constexpr float padding = 6.0f;
-
-                            coordinateFrame.setSize(sf::Vector2f(
-                                textBounds.width + 2 * padding, textBounds.height + 2 * padding));
-                            coordinateFrame.setPosition(10, 10);
-
-                            coordinateText.setPosition(coordinateFrame.getPosition().x + padding,
-                                                       coordinateFrame.getPosition().y + padding -
-                                                       textBounds.top);
-                        }
-                    } else {
-                        showCoordinates = false;
-                    }
+        if (dirty_ == 0) {
+            // a graph in progress cannot wake the thread from waiting for events
+            if (!graphPending()) {
+                if (window.waitEvent(event)) {
+                    handleEvent(window, event);
                 }
-            } else if (event.type == sf::Event::KeyPressed && event.key.code ==
-                       sf::Keyboard::Escape) {
-                showCoordinates = false;
+            } else {
+                std::this_thread::sleep_for(GRAPH_POLL_INTERVAL);
             }
         }
-        if (shouldReevaluatePlotData()) {
-            updatePlotData();
+        while (window.pollEvent(event)) {
+            handleEvent(window, event);
         }
-
-        window.clear(sf::Color::White);
-
-        if (config.drawAxes) {
-            auto grid = renderGrid({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE});
-            drawVertices(window, grid);
+        if (receiveGraphs()) {
+            dirty_ |= DATA_DIRTY;
         }
-        if (config.drawAxes) {
-            auto axes = renderAxes({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE});
-            drawVertices(window, axes);
+        if (window.isOpen() && dirty_ != 0) {
+            drawFrame(window);
         }
-        auto graph = renderGraph({ABSOLUTE_WINDOW_SIZE, ABSOLUTE_WINDOW_SIZE});
-        drawGraph(window, graph);
-        delete[] graph;
-        if (config.drawUi) {
-            drawUI(window);
-        }
-
-        window.display();
     }
+    stopGraphThread();
+    if (config.printFrameStatistics && frameStatistics_.frames > 0) {
+        std::cout << "Frames drawn: " << frameStatistics_.frames << ", rebuilt: "
+                << frameStatistics_.rebuilt << ", mean frame time: "
+                << frameStatistics_.totalFrameTime.count() / frameStatistics_.frames
+                << " us, longest: " << frameStatistics_.longestFrameTime.count()
+                << " us, allocations building the last graph: "
+                << frameStatistics_.lastGraphAllocations << std::endl;
+    }
+}
+
+const FrameStatistics& Visualizer::frameStatistics() const {
+    return frameStatistics_;
 }
 
 Visualizer::~Visualizer() {
-    delete plotData;
+    stopGraphThread();
 }
@@ -1,14 +1,47 @@
 #ifndef VISUALIZATION_H
 #define VISUALIZATION_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <interface/plotter2d.h>
 #include <SFML/Graphics/RectangleShape.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Graphics/Text.hpp>
 
+#include "decimation.h"
+#include "spsc_queue.h"
 #include "evaluation/function_evaluator.h"
 #include "model/plot_model.h"
 
+/**
+ * Counters of the frames drawn by a Visualizer
+ * frames - frames drawn
+ * rebuilt - frames showing a graph newly built by the evaluation thread; the other ones redraw
+ * the last one, moved by a transform if the view was panned or zoomed
+ * lastFrameTime, longestFrameTime, totalFrameTime - time spent preparing and drawing the frames,
+ * excluding waiting for the frame rate limit and the evaluation done by the evaluation thread
+ * lastFrameAllocations - heap allocations made by the drawing thread while preparing and drawing
+ * the last frame, counted only if built with PLOTTER2D_COUNT_ALLOCATIONS (see
+ * plotter2d::allocationCount)
+ * lastGraphAllocations - heap allocations made by the evaluation thread while the last graph
+ * received was built, counted likewise; those of the evaluator's worker threads are not counted.
+ * None once the graph is built from samples the evaluator already holds, unless it was rescaled
+ */
+struct FrameStatistics {
+    size_t frames = 0;
+    size_t rebuilt = 0;
+    std::chrono::microseconds lastFrameTime{0};
+    std::chrono::microseconds longestFrameTime{0};
+    std::chrono::microseconds totalFrameTime{0};
+    size_t lastFrameAllocations = 0;
+    size_t lastGraphAllocations = 0;
+};
+
 class Visualizer {
     sf::Text coordinateText;
     bool showCoordinates;
@@ -18,8 +51,11 @@ class Visualizer {
                                    const sf::Vector2u& windowSize) const;
 
     plotter2d::Options config;
+    /**
+     * Used by the evaluation thread only, once it is started
+     */
     FunctionEvaluator evaluator;
-    PlotData* plotData;
+    PlotData plotData;
     double zoomFactor;
     Point zoomCenter;
 
@@ -32,9 +68,94 @@ class Visualizer {
     double yMax_;
     bool rescaleY_;
     bool useCustomPlotRange_;
-    mutable int validPointCount_{};
     std::pair<double, double> plotRange_;
     sf::RectangleShape coordinateFrame;
+    /**
+     * Parts of the frame changed since it was last drawn; the window is redrawn only if any did
+     */
+    enum DirtyFlag {
+        VIEW_DIRTY = 1,
+        DATA_DIRTY = 2,
+        UI_DIRTY = 4
+    };
+
+    unsigned dirty_;
+    std::vector<sf::Vertex> gridVertices_;
+    std::vector<sf::Vertex> axesVertices_;
+    PixelDecimator graphDecimator_;
+
+    /**
+     * A view of the plane to build the graph for, posted by the UI thread to the evaluation
+     * thread; a newer request replaces the one posted before if that was not taken yet
+     * view - The visible part of the plane
+     * range - The range of x to evaluate, beyond the view by its margin
+     * rescale - whether to fit the range of y of the view to the evaluated samples
+     * derivatives - The number of derivatives to add to the plotted functions first
+     * generation - The number of requests posted so far
+     */
+    struct GraphRequest {
+        Rectangle view{0, 0, Point(0, 0)};
+        std::pair<double, double> range;
+        bool rescale = false;
+        unsigned derivatives = 0;
+        std::uint64_t generation = 0;
+    };
+
+    /**
+     * A graph built by the evaluation thread and drawn by the UI thread
+     * vertices - The vertices, in units of a fraction of a pixel of the view they were built for,
+     * relative to the corner of that view; pan and zoom move them by graphTransform_ only. They
+     * keep their memory from build to build, so neither building nor drawing allocates.
+     * stripEnds - End of the vertices of each line strip; the line of a function is broken into
+     * strips at its gaps
+     * vertexCount - The number of the vertices in use
+     * view - The visible part of the plane the graph was built for, with the range of y fitted to
+     * the samples if the request asked to rescale
+     * generation - The request the graph was built for
+     * allocations - The heap allocations made by the evaluation thread while building the graph
+     */
+    struct GraphFrame {
+        std::vector<sf::Vertex> vertices;
+        std::vector<int> stripEnds;
+        int vertexCount = 0;
+        Rectangle view{0, 0, Point(0, 0)};
+        bool rescaled = false;
+        std::uint64_t generation = 0;
+        size_t allocations = 0;
+    };
+
+    /**
+     * The graphs circulate between the threads: the evaluation thread builds a free one and
+     * queues it as ready, the UI thread shows the newest ready one and frees the one it showed
+     * before. The queues hold every graph at once, so pushing to them never fails.
+     */
+    static constexpr size_t GRAPH_FRAMES = 3;
+    std::array<GraphFrame, GRAPH_FRAMES> graphFrames_;
+    SpscQueue<GraphFrame*, GRAPH_FRAMES> freeGraphs_;
+    SpscQueue<GraphFrame*, GRAPH_FRAMES> readyGraphs_;
+    GraphFrame* shownGraph_ = nullptr;
+    std::thread graphThread_;
+    /**
+     * Guards the posted request; the evaluation thread waits for a new one on requestPosted_
+     */
+    std::mutex requestMutex_;
+    std::condition_variable requestPosted_;
+    GraphRequest request_;
+    std::atomic<bool> stopping_ = false;
+    /**
+     * The exception the evaluation thread stopped on, rethrown by the UI thread
+     */
+    std::exception_ptr graphFailure_;
+    std::atomic<bool> graphFailed_ = false;
+    /**
+     * The last request posted by the UI thread; the view is updated to the rescaled one once its
+     * graph arrives
+     */
+    std::uint64_t requestedGeneration_ = 0;
+    Rectangle requestedView_;
+    std::pair<double, double> requestedRange_;
+    sf::Transform graphTransform_;
+    FrameStatistics frameStatistics_;
     /*
      * BUTTONS
      */
@@ -74,9 +195,37 @@ class Visualizer {
 
     void initializeButtons(const sf::Vector2u& windowSize);
 
-    void updatePlotData();
+    /**
+     * @brief Evaluates the functions and builds the graph for a request, on the evaluation thread
+     */
+    void buildGraph(const GraphRequest& request, GraphFrame& graph);
 
-    void drawGraph(sf::RenderWindow& window, const sf::Vertex* lines) const;
+    /**
+     * @brief Builds the graphs for the posted requests until stopped; the body of the evaluation
+     * thread
+     */
+    void produceGraphs();
+
+    /**
+     * @brief Posts a request for the graph of the current view to the evaluation thread
+     */
+    void requestGraph();
+
+    /**
+     * @brief Takes the graphs built since the last call, showing the newest one
+     * @return whether any graph was taken
+     * @throws the exception the evaluation thread stopped on, if it did
+     */
+    bool receiveGraphs();
+
+    /**
+     * @return whether the graph of the last request is still being built
+     */
+    bool graphPending() const;
+
+    void stopGraphThread();
+
+    void drawGraph(sf::RenderWindow& window, const GraphFrame& graph) const;
 
     static bool isMouseInButton(const sf::Vector2f& mousePosition,
                                 const sf::RectangleShape& button);
@@ -84,19 +233,40 @@ class Visualizer {
     sf::Vector2f scalePoint(const Point& p, const unsigned effectiveSize[2],
                             const unsigned offset[2]) const;
 
-    sf::Vertex* renderGraph(const sf::Vector2u& windowSize) const;
+    /**
+     * @brief Computes the transform from the coordinates of the graph vertices to the screen
+     * for the current view
+     * @param graphView the visible part of the plane the vertices were built for
+     */
+    sf::Transform calculateGraphTransform(const sf::Vector2u& windowSize,
+                                          const Rectangle& graphView) const;
+
+    void renderGraph(const sf::Vector2u& windowSize, GraphFrame& graph);
 
     static double calculateAxisPosition(double min, double max);
 
-    std::vector<sf::Vertex> renderGrid(const sf::Vector2u& windowSize) const;
+    void renderGrid(const sf::Vector2u& windowSize, std::vector<sf::Vertex>& grid) const;
 
-    std::vector<sf::Vertex> renderAxes(const sf::Vector2u& windowSize) const;
+    void renderAxes(const sf::Vector2u& windowSize, std::vector<sf::Vertex>& axes) const;
 
     void drawUI(sf::RenderWindow& window);
 
-    bool doublesSignificantlyDiffer(double a, double b) const;
+    /**
+     * @brief Handles a window event, marking the parts of the frame it changes as dirty
+     */
+    void handleEvent(sf::RenderWindow& window, const sf::Event& event);
+
+    /**
+     * @brief Draws the frame with the newest graph received, requesting a new graph if the view
+     * changed beyond it, and clears the dirty flags
+     */
+    void drawFrame(sf::RenderWindow& window);
 
-    bool shouldReevaluatePlotData() const;
+    /**
+     * @return whether the last requested graph no longer covers the view, or it was zoomed
+     * beyond what moving the vertices can show in detail
+     */
+    bool shouldRequestGraph() const;
 
     void panLeft();
 
@@ -112,8 +282,17 @@ class Visualizer {
 
         Visualizer(const Visualizer&) = delete;
 
+        /**
+         * @brief Opens the plot window and handles it until closed. The functions are evaluated
+         * and the graph built on a separate evaluation thread, so the window keeps handling
+         * events, showing the last graph built, while a newer one is in progress. The window is
+         * redrawn only after events changing it or a new graph; in between the thread sleeps
+         * waiting for events.
+         */
         void render();
 
+        const FrameStatistics& frameStatistics() const;
+
         static void drawVertices(sf::RenderWindow& window, const std::vector<sf::Vertex>& axes);
 
         void zoomIn();